@@ -1,15 +1,48 @@
 // Copyright (C) Thyke. All Rights Reserved.
 
 #include "VertexBlueprintFunctionLibrary.h"
+#include "VertexPaintCacheSubsystem.h"
+#include "VertexPaintMeshAdjacency.h"
+#include "VertexPaintSkinnedPositionCache.h"
+#include "VertexPaintableComponentSubsystem.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "Rendering/SkeletalMeshLODRenderData.h"
+#include "Rendering/SkeletalMeshRenderData.h"
 #include "StaticMeshComponentLODInfo.h"
 #include "Kismet/KismetMathLibrary.h"
 #include "Kismet/KismetSystemLibrary.h"
+#include "RenderCommandFence.h"
 #include "RenderingThread.h"
 #include "RHI.h"
 #include "Engine/Texture2D.h"
+#include "Engine/Engine.h"
+#include "Engine/OverlapResult.h"
+#include "Engine/World.h"
+#include "Async/ParallelFor.h"
 
 #include UE_INLINE_GENERATED_CPP_BY_NAME(VertexBlueprintFunctionLibrary)
 
+namespace VertexPaintColorUploads
+{
+    /** Painted vertices closer than this in the buffer are uploaded as one range */
+    static constexpr int32 MaxRangeGap = 32;
+
+    /** Color buffers whose initial upload may still be reading their CPU copy on the render thread */
+    static TMap<const FColorVertexBuffer*, TSharedPtr<FRenderCommandFence>> PendingInitFences;
+
+    /**
+     * Waits until the render thread is done initializing the buffer, so its CPU copy can be edited
+     */
+    static void WaitForInit(const FColorVertexBuffer* VertexColors)
+    {
+        if (const TSharedPtr<FRenderCommandFence>* InitFence = PendingInitFences.Find(VertexColors))
+        {
+            (*InitFence)->Wait();
+            PendingInitFences.Remove(VertexColors);
+        }
+    }
+}
+
 bool UVertexBlueprintFunctionLibrary::ValidateMeshForPainting(UStaticMeshComponent* StaticMeshComponent, int32 LODIndex, int32& OutVertexCount)
 {
     if (!StaticMeshComponent)
@@ -39,23 +72,134 @@ bool UVertexBlueprintFunctionLibrary::ValidateMeshForPainting(UStaticMeshCompone
 
 void UVertexBlueprintFunctionLibrary::ApplyColorBuffer(UStaticMeshComponent* StaticMeshComponent, int32 LODIndex, const TArray<FColor>& VertexColors)
 {
-    FStaticMeshComponentLODInfo& LODInfo = StaticMeshComponent->LODData[LODIndex];
+    // Create new buffer
+    FColorVertexBuffer* NewVertexColors = new FColorVertexBuffer;
+    NewVertexColors->InitFromColorArray(VertexColors);
     
-    // Clear old buffer if exists
-    if (LODInfo.OverrideVertexColors)
+    ApplyColorVertexBuffer(StaticMeshComponent, LODIndex, NewVertexColors);
+}
+
+void UVertexBlueprintFunctionLibrary::ApplyColorVertexBuffer(UStaticMeshComponent* StaticMeshComponent, int32 LODIndex, FColorVertexBuffer* NewVertexColors)
+{
+    FVertexPaintColorUpload Upload;
+    Upload.StaticMeshComponent = StaticMeshComponent;
+    Upload.LODIndex = LODIndex;
+    Upload.VertexColors = NewVertexColors;
+    
+    ApplyColorVertexBuffers(MakeArrayView(&Upload, 1));
+}
+
+void UVertexBlueprintFunctionLibrary::ApplyColorVertexBuffers(TArrayView<const FVertexPaintColorUpload> Uploads)
+{
+    for (auto It = VertexPaintColorUploads::PendingInitFences.CreateIterator(); It; ++It)
+    {
+        if (It.Value()->IsFenceComplete())
+        {
+            It.RemoveCurrent();
+        }
+    }
+    
+    // Release all old buffers, then wait for the render thread once for the whole batch
+    TArray<FColorVertexBuffer*> ReleasedVertexColors;
+    for (const FVertexPaintColorUpload& Upload : Uploads)
+    {
+        FStaticMeshComponentLODInfo& LODInfo = Upload.StaticMeshComponent->LODData[Upload.LODIndex];
+        if (LODInfo.OverrideVertexColors)
+        {
+            VertexPaintColorUploads::PendingInitFences.Remove(LODInfo.OverrideVertexColors);
+            BeginReleaseResource(LODInfo.OverrideVertexColors);
+            ReleasedVertexColors.Add(LODInfo.OverrideVertexColors);
+            LODInfo.OverrideVertexColors = nullptr;
+        }
+    }
+    
+    if (ReleasedVertexColors.Num() > 0)
     {
-        BeginReleaseResource(LODInfo.OverrideVertexColors);
         FlushRenderingCommands();
-        delete LODInfo.OverrideVertexColors;
-        LODInfo.OverrideVertexColors = nullptr;
+        for (FColorVertexBuffer* ReleasedBuffer : ReleasedVertexColors)
+        {
+            delete ReleasedBuffer;
+        }
+    }
+    
+    // Initialize new buffers
+    for (const FVertexPaintColorUpload& Upload : Uploads)
+    {
+        UStaticMeshComponent* StaticMeshComponent = Upload.StaticMeshComponent;
+        FStaticMeshComponentLODInfo& LODInfo = StaticMeshComponent->LODData[Upload.LODIndex];
+        LODInfo.OverrideVertexColors = Upload.VertexColors;
+        BeginInitResource(LODInfo.OverrideVertexColors);
+        
+        StaticMeshComponent->MarkRenderStateDirty();
+        NotifyComponentPainted(StaticMeshComponent);
+    }
+    
+    // The initialization reads the CPU copies, which must not be edited in place until it is done
+    const TSharedPtr<FRenderCommandFence> InitFence = MakeShared<FRenderCommandFence>();
+    InitFence->BeginFence();
+    for (const FVertexPaintColorUpload& Upload : Uploads)
+    {
+        VertexPaintColorUploads::PendingInitFences.Add(Upload.VertexColors, InitFence);
+    }
+}
+
+void UVertexBlueprintFunctionLibrary::UpdateColorVertexBuffer(UStaticMeshComponent* StaticMeshComponent, int32 LODIndex, TArray<int32> VertexIndices)
+{
+    struct FColorRange
+    {
+        uint32 FirstVertex = 0;
+        TArray<FColor> Colors;
+    };
+    
+    // Copy the painted ranges now; the render thread only writes them to the GPU buffer and never reads the CPU copy
+    FColorVertexBuffer* VertexColors = StaticMeshComponent->LODData[LODIndex].OverrideVertexColors;
+    VertexIndices.Sort();
+    
+    TArray<FColorRange> Ranges;
+    for (int32 Index = 0; Index < VertexIndices.Num();)
+    {
+        const int32 FirstVertex = VertexIndices[Index];
+        int32 LastVertex = FirstVertex;
+        while (++Index < VertexIndices.Num() && VertexIndices[Index] - LastVertex <= VertexPaintColorUploads::MaxRangeGap)
+        {
+            LastVertex = VertexIndices[Index];
+        }
+        
+        FColorRange& Range = Ranges.AddDefaulted_GetRef();
+        Range.FirstVertex = FirstVertex;
+        Range.Colors.SetNumUninitialized(LastVertex - FirstVertex + 1);
+        FMemory::Memcpy(Range.Colors.GetData(), &VertexColors->VertexColor(FirstVertex), Range.Colors.Num() * sizeof(FColor));
     }
     
-    // Create and initialize new buffer
-    LODInfo.OverrideVertexColors = new FColorVertexBuffer;
-    LODInfo.OverrideVertexColors->InitFromColorArray(VertexColors);
-    BeginInitResource(LODInfo.OverrideVertexColors);
+    ENQUEUE_RENDER_COMMAND(VertexPaintUpdateColorBuffer)([VertexColors, Ranges = MoveTemp(Ranges)](FRHICommandListImmediate& RHICmdList)
+    {
+        if (!VertexColors->IsInitialized() || !VertexColors->VertexBufferRHI.IsValid())
+        {
+            return;
+        }
+        
+        for (const FColorRange& Range : Ranges)
+        {
+            const uint32 RangeSize = Range.Colors.Num() * sizeof(FColor);
+            void* Data = RHICmdList.LockBuffer(VertexColors->VertexBufferRHI, Range.FirstVertex * sizeof(FColor), RangeSize, RLM_WriteOnly);
+            FMemory::Memcpy(Data, Range.Colors.GetData(), RangeSize);
+            RHICmdList.UnlockBuffer(VertexColors->VertexBufferRHI);
+        }
+    });
     
-    StaticMeshComponent->MarkRenderStateDirty();
+    NotifyComponentPainted(StaticMeshComponent);
+}
+
+void UVertexBlueprintFunctionLibrary::NotifyComponentPainted(UStaticMeshComponent* StaticMeshComponent)
+{
+    // Remember painted components so their paint survives level streaming
+    if (UWorld* World = StaticMeshComponent->GetWorld())
+    {
+        if (UVertexPaintCacheSubsystem* PaintCache = World->GetSubsystem<UVertexPaintCacheSubsystem>())
+        {
+            PaintCache->NotifyComponentPainted(StaticMeshComponent);
+        }
+    }
 }
 
 float UVertexBlueprintFunctionLibrary::GetVertexDistanceNormalizedToShape(const FVector& VertexPosition, EVertexPaintShape Shape, const FVector& Location, const FVector& Dimensions, const FRotator& Rotation)
@@ -108,6 +252,17 @@ float UVertexBlueprintFunctionLibrary::GetVertexDistanceNormalizedToShape(const
     return NormalizedDistance;
 }
 
+float UVertexBlueprintFunctionLibrary::GetFalloffAlpha(float NormalizedDistance, float Falloff)
+{
+    if (NormalizedDistance <= Falloff)
+    {
+        return 1.0f;
+    }
+    
+    // Linear interpolation between falloff and 1.0
+    return 1.0f - ((NormalizedDistance - Falloff) / (1.0f - Falloff));
+}
+
 FColor UVertexBlueprintFunctionLibrary::BlendVertexColors(FColor BaseColor, FColor BlendColor, EVertexColorBlendMode BlendMode, float BlendStrength)
 {
     FLinearColor LinearBase = FLinearColor::FromSRGBColor(BaseColor);
@@ -188,20 +343,24 @@ TArray<FColor> UVertexBlueprintFunctionLibrary::GetStaticMeshVertexColors(UStati
         return VertexColors;
     }
     
-    VertexColors.SetNum(VertexNum);
-    VertexColors.Init(FColor::White, VertexNum);
+    ReadVertexColors(StaticMeshComponent, LODIndex, VertexNum, VertexColors);
+    
+    return VertexColors;
+}
+
+void UVertexBlueprintFunctionLibrary::ReadVertexColors(const UStaticMeshComponent* StaticMeshComponent, int32 LODIndex, int32 VertexNum, TArray<FColor>& OutVertexColors)
+{
+    OutVertexColors.Init(FColor::White, VertexNum);
     
-    FStaticMeshComponentLODInfo& LODInfo = StaticMeshComponent->LODData[LODIndex];
+    const FStaticMeshComponentLODInfo& LODInfo = StaticMeshComponent->LODData[LODIndex];
     if (LODInfo.OverrideVertexColors)
     {
-        LODInfo.OverrideVertexColors->GetVertexColors(VertexColors);
+        LODInfo.OverrideVertexColors->GetVertexColors(OutVertexColors);
     }
     else if (StaticMeshComponent->GetStaticMesh()->GetRenderData()->LODResources[LODIndex].bHasColorVertexData)
     {
-        StaticMeshComponent->GetStaticMesh()->GetRenderData()->LODResources[LODIndex].VertexBuffers.ColorVertexBuffer.GetVertexColors(VertexColors);
+        StaticMeshComponent->GetStaticMesh()->GetRenderData()->LODResources[LODIndex].VertexBuffers.ColorVertexBuffer.GetVertexColors(OutVertexColors);
     }
-    
-    return VertexColors;
 }
 
 void UVertexBlueprintFunctionLibrary::OverrideStaticMeshVertexColor(UStaticMeshComponent* StaticMeshComponent, int32 LODIndex, TArray<FVertexOverrideColorInfo> VertexOverrideColorInfos)
@@ -265,23 +424,51 @@ bool UVertexBlueprintFunctionLibrary::PaintMeshRegion(UStaticMeshComponent* Stat
         return false;
     }
     
-    // Transform world location to mesh's local coordinates
-    const FTransform StaticMeshWorldTransform = StaticMeshComponent->GetComponentTransform();
-    const FVector LocationInMeshTransform = UKismetMathLibrary::InverseTransformLocation(StaticMeshWorldTransform, Location);
-    const FRotator RotationInMeshTransform = UKismetMathLibrary::InverseTransformRotation(StaticMeshWorldTransform, Rotation);
-    
     // Get vertex positions and current colors
     const FPositionVertexBuffer& VertexPositionBuffer = StaticMeshComponent->GetStaticMesh()->GetRenderData()->LODResources[LODIndex].VertexBuffers.PositionVertexBuffer;
     TArray<FColor> VertexColors = GetStaticMeshVertexColors(StaticMeshComponent, LODIndex);
     
+    const bool bAnyVertexPainted = PaintRegionColors(
+        VertexNum,
+        [&VertexPositionBuffer](int32 VertexIndex) { return FVector(VertexPositionBuffer.VertexPosition(VertexIndex)); },
+        StaticMeshComponent->GetComponentTransform(),
+        Shape,
+        Location,
+        Dimensions,
+        Rotation,
+        Color,
+        BlendMode,
+        BlendStrength,
+        Falloff,
+        VertexColors
+    );
+    
+    if (bAnyVertexPainted)
+    {
+        ApplyColorBuffer(StaticMeshComponent, LODIndex, VertexColors);
+    }
+    
+    return bAnyVertexPainted;
+}
+
+template<typename GetVertexPositionType>
+bool UVertexBlueprintFunctionLibrary::PaintRegionColors(int32 VertexNum, const GetVertexPositionType& GetVertexPosition, const FTransform& ComponentTransform, EVertexPaintShape Shape, const FVector& Location, const FVector& Dimensions, const FRotator& Rotation, const FLinearColor& Color, EVertexColorBlendMode BlendMode, float BlendStrength, float Falloff, TArray<FColor>& VertexColors)
+{
+    // Transform world location to mesh's local coordinates
+    const FVector LocationInMeshTransform = UKismetMathLibrary::InverseTransformLocation(ComponentTransform, Location);
+    const FRotator RotationInMeshTransform = UKismetMathLibrary::InverseTransformRotation(ComponentTransform, Rotation);
+    
     // Limit falloff value
     Falloff = FMath::Clamp(Falloff, 0.01f, 0.99f);
     
+    const FColor PaintColor = Color.ToFColor(true);
+    VertexNum = FMath::Min(VertexNum, VertexColors.Num());
+    
     // Process each vertex
     bool bAnyVertexPainted = false;
     for (int32 VertexIndex = 0; VertexIndex < VertexNum; VertexIndex++)
     {
-        const FVector VertexPosition = static_cast<UE::Math::TVector4<double>>(VertexPositionBuffer.VertexPosition(VertexIndex));
+        const FVector VertexPosition = GetVertexPosition(VertexIndex);
         
         // Calculate normalized distance based on shape
         const float NormalizedDistance = GetVertexDistanceNormalizedToShape(
@@ -297,33 +484,134 @@ bool UVertexBlueprintFunctionLibrary::PaintMeshRegion(UStaticMeshComponent* Stat
         {
             bAnyVertexPainted = true;
             
-            // Calculate falloff (edges are less affected)
-            float DistanceAlpha = 1.0f;
-            if (NormalizedDistance > Falloff)
-            {
-                // Linear interpolation between falloff and 1.0
-                DistanceAlpha = 1.0f - ((NormalizedDistance - Falloff) / (1.0f - Falloff));
-            }
-            
-            // Calculate effective blend value
-            float EffectiveBlendStrength = BlendStrength * DistanceAlpha;
+            // Calculate effective blend value (edges are less affected)
+            float EffectiveBlendStrength = BlendStrength * GetFalloffAlpha(NormalizedDistance, Falloff);
             
             // Blend colors
             VertexColors[VertexIndex] = BlendVertexColors(
                 VertexColors[VertexIndex], 
-                Color.ToFColor(true), 
+                PaintColor, 
                 BlendMode, 
                 EffectiveBlendStrength
             );
         }
     }
     
-    if (bAnyVertexPainted)
+    return bAnyVertexPainted;
+}
+
+bool UVertexBlueprintFunctionLibrary::PaintRegionColors(TConstArrayView<FVector3f> VertexPositions, const FTransform& ComponentTransform, EVertexPaintShape Shape, const FVector& Location, const FVector& Dimensions, const FRotator& Rotation, const FLinearColor& Color, EVertexColorBlendMode BlendMode, float BlendStrength, float Falloff, TArray<FColor>& VertexColors)
+{
+    return PaintRegionColors(
+        VertexPositions.Num(),
+        [VertexPositions](int32 VertexIndex) { return FVector(VertexPositions[VertexIndex]); },
+        ComponentTransform,
+        Shape,
+        Location,
+        Dimensions,
+        Rotation,
+        Color,
+        BlendMode,
+        BlendStrength,
+        Falloff,
+        VertexColors
+    );
+}
+
+bool UVertexBlueprintFunctionLibrary::PaintMeshAtHit(UStaticMeshComponent* StaticMeshComponent, const FHitResult& Hit, float Radius, FLinearColor Color, EVertexColorBlendMode BlendMode, float BlendStrength, float Falloff, int32 LODIndex)
+{
+    if (!StaticMeshComponent)
     {
-        ApplyColorBuffer(StaticMeshComponent, LODIndex, VertexColors);
+        StaticMeshComponent = Cast<UStaticMeshComponent>(Hit.GetComponent());
     }
     
-    return bAnyVertexPainted;
+    int32 VertexNum = 0;
+    if (!ValidateMeshForPainting(StaticMeshComponent, LODIndex, VertexNum))
+    {
+        return false;
+    }
+    
+    // Without a usable hit triangle, scan the whole mesh instead
+    auto PaintVolumetric = [&]()
+    {
+        return PaintMeshRegion(StaticMeshComponent, EVertexPaintShape::Sphere, Hit.ImpactPoint, FVector(Radius), FRotator::ZeroRotator, Color, BlendMode, BlendStrength, Falloff, LODIndex);
+    };
+    
+    if (Hit.FaceIndex == INDEX_NONE || Hit.GetComponent() != StaticMeshComponent)
+    {
+        return PaintVolumetric();
+    }
+    
+    UStaticMesh* StaticMesh = StaticMeshComponent->GetStaticMesh();
+    const TSharedPtr<const FVertexPaintMeshAdjacency> Adjacency = FVertexPaintMeshAdjacencyCache::Get(StaticMesh, LODIndex);
+    if (!Adjacency.IsValid() || !Adjacency->CollisionFaceToTriangle.IsValidIndex(Hit.FaceIndex))
+    {
+        return PaintVolumetric();
+    }
+    
+    // Transform hit location to mesh's local coordinates
+    const FTransform StaticMeshWorldTransform = StaticMeshComponent->GetComponentTransform();
+    const FVector HitLocationInMeshTransform = UKismetMathLibrary::InverseTransformLocation(StaticMeshWorldTransform, Hit.ImpactPoint);
+    const FPositionVertexBuffer& VertexPositionBuffer = StaticMesh->GetRenderData()->LODResources[LODIndex].VertexBuffers.PositionVertexBuffer;
+    const float BrushRadius = FMath::Max(0.1f, Radius);
+    
+    // The seed triangle must actually be under the brush, otherwise collision was not cooked from these triangles
+    const int32 SeedTriangle = Adjacency->CollisionFaceToTriangle[Hit.FaceIndex];
+    const FVector ClosestPointOnSeed = FMath::ClosestPointOnTriangleToPoint(
+        HitLocationInMeshTransform,
+        FVector(VertexPositionBuffer.VertexPosition(Adjacency->Indices[SeedTriangle * 3 + 0])),
+        FVector(VertexPositionBuffer.VertexPosition(Adjacency->Indices[SeedTriangle * 3 + 1])),
+        FVector(VertexPositionBuffer.VertexPosition(Adjacency->Indices[SeedTriangle * 3 + 2]))
+    );
+    if (FVector::Dist(ClosestPointOnSeed, HitLocationInMeshTransform) > BrushRadius)
+    {
+        return PaintVolumetric();
+    }
+    
+    // Walk outward from the hit triangle until the brush radius is used up
+    TArray<int32> PaintedVertices;
+    TArray<float> PaintedDistances;
+    Adjacency->CollectVerticesInRadius(VertexPositionBuffer, SeedTriangle, HitLocationInMeshTransform, BrushRadius, PaintedVertices, PaintedDistances);
+    
+    if (PaintedVertices.Num() == 0)
+    {
+        return false;
+    }
+    
+    // Limit falloff value
+    Falloff = FMath::Clamp(Falloff, 0.01f, 0.99f);
+    
+    const FColor PaintColor = Color.ToFColor(true);
+    auto PaintVertexColor = [&](FColor& VertexColor, int32 PaintedIndex)
+    {
+        const float NormalizedDistance = PaintedDistances[PaintedIndex] / BrushRadius;
+        VertexColor = BlendVertexColors(VertexColor, PaintColor, BlendMode, BlendStrength * GetFalloffAlpha(NormalizedDistance, Falloff));
+    };
+    
+    // Once the LOD has its own color buffer, only the painted entries of its CPU copy are touched
+    FColorVertexBuffer* OverrideVertexColors = StaticMeshComponent->LODData[LODIndex].OverrideVertexColors;
+    if (OverrideVertexColors && OverrideVertexColors->GetVertexData() && static_cast<int32>(OverrideVertexColors->GetNumVertices()) == VertexNum)
+    {
+        VertexPaintColorUploads::WaitForInit(OverrideVertexColors);
+        for (int32 PaintedIndex = 0; PaintedIndex < PaintedVertices.Num(); PaintedIndex++)
+        {
+            PaintVertexColor(OverrideVertexColors->VertexColor(PaintedVertices[PaintedIndex]), PaintedIndex);
+        }
+        
+        UpdateColorVertexBuffer(StaticMeshComponent, LODIndex, MoveTemp(PaintedVertices));
+        return true;
+    }
+    
+    // First stroke on this LOD: create the color buffer
+    TArray<FColor> VertexColors = GetStaticMeshVertexColors(StaticMeshComponent, LODIndex);
+    for (int32 PaintedIndex = 0; PaintedIndex < PaintedVertices.Num(); PaintedIndex++)
+    {
+        PaintVertexColor(VertexColors[PaintedVertices[PaintedIndex]], PaintedIndex);
+    }
+    
+    ApplyColorBuffer(StaticMeshComponent, LODIndex, VertexColors);
+    
+    return true;
 }
 
 bool UVertexBlueprintFunctionLibrary::PaintMeshWithParameters(UStaticMeshComponent* StaticMeshComponent, const FVertexPaintParameters& Parameters, int32 LODIndex)
@@ -372,6 +660,229 @@ bool UVertexBlueprintFunctionLibrary::PaintMeshWithParameters(UStaticMeshCompone
     }
 }
 
+TArray<UStaticMeshComponent*> UVertexBlueprintFunctionLibrary::PaintWorldRegion(const UObject* WorldContextObject, const FVertexPaintParameters& Parameters, int32 LODIndex)
+{
+    TArray<UStaticMeshComponent*> PaintedComponents;
+    
+    UWorld* World = GEngine ? GEngine->GetWorldFromContextObject(WorldContextObject, EGetWorldErrorMode::LogAndReturnNull) : nullptr;
+    if (!World)
+    {
+        return PaintedComponents;
+    }
+    
+    // Build the broadphase shape; same extents as GetVertexDistanceNormalizedToShape
+    const FQuat ShapeRotation = Parameters.Rotation.Quaternion();
+    const bool bSphericalShape = Parameters.PaintShape == EVertexPaintShape::Point || Parameters.PaintShape == EVertexPaintShape::Sphere;
+    const float SphereRadius = FMath::Max(0.1f, Parameters.Dimensions.X);
+    
+    FVector BoxExtent = Parameters.Dimensions * 0.5f;
+    if (Parameters.PaintShape == EVertexPaintShape::Cylinder)
+    {
+        BoxExtent = FVector(Parameters.Dimensions.X * 0.5f, Parameters.Dimensions.X * 0.5f, Parameters.Dimensions.Z * 0.5f);
+    }
+    
+    const FCollisionShape QueryShape = bSphericalShape ? FCollisionShape::MakeSphere(SphereRadius) : FCollisionShape::MakeBox(BoxExtent);
+    const FBox ShapeBounds = bSphericalShape
+        ? FBox(Parameters.Location - FVector(SphereRadius), Parameters.Location + FVector(SphereRadius))
+        : FBox(-BoxExtent, BoxExtent).TransformBy(FTransform(ShapeRotation, Parameters.Location));
+    
+    // Gather candidates from the physics scene and from components registered as paintable
+    TSet<UStaticMeshComponent*> CandidateComponents;
+    
+    TArray<FOverlapResult> Overlaps;
+    const FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(VertexPaintWorldRegion), false);
+    World->OverlapMultiByObjectType(Overlaps, Parameters.Location, ShapeRotation, FCollisionObjectQueryParams(FCollisionObjectQueryParams::AllObjects), QueryShape, QueryParams);
+    for (const FOverlapResult& Overlap : Overlaps)
+    {
+        if (UStaticMeshComponent* OverlappedComponent = Cast<UStaticMeshComponent>(Overlap.GetComponent()))
+        {
+            CandidateComponents.Add(OverlappedComponent);
+        }
+    }
+    
+    if (const UVertexPaintableComponentSubsystem* PaintableComponents = World->GetSubsystem<UVertexPaintableComponentSubsystem>())
+    {
+        for (const TWeakObjectPtr<UStaticMeshComponent>& PaintableComponent : PaintableComponents->GetPaintableComponents())
+        {
+            UStaticMeshComponent* RegisteredComponent = PaintableComponent.Get();
+            if (RegisteredComponent && RegisteredComponent->IsRegistered())
+            {
+                CandidateComponents.Add(RegisteredComponent);
+            }
+        }
+    }
+    
+    // Cull by bounds and validate on the game thread, since validation resizes component LOD data
+    struct FWorldPaintJob
+    {
+        UStaticMeshComponent* StaticMeshComponent = nullptr;
+        int32 LODIndex = 0;
+        int32 VertexNum = 0;
+        FColorVertexBuffer* VertexColors = nullptr;
+    };
+    TArray<FWorldPaintJob> Jobs;
+    
+    for (UStaticMeshComponent* CandidateComponent : CandidateComponents)
+    {
+        if (!CandidateComponent->IsRegistered() || !CandidateComponent->GetStaticMesh())
+        {
+            continue;
+        }
+        
+        const FBox ComponentBounds = CandidateComponent->Bounds.GetBox();
+        const bool bInBounds = bSphericalShape
+            ? FMath::SphereAABBIntersection(FSphere(Parameters.Location, SphereRadius), ComponentBounds)
+            : ComponentBounds.Intersect(ShapeBounds);
+        if (!bInBounds)
+        {
+            continue;
+        }
+        
+        const int32 FirstLOD = Parameters.bApplyToAllLODs ? 0 : LODIndex;
+        const int32 LastLOD = Parameters.bApplyToAllLODs ? CandidateComponent->GetStaticMesh()->GetNumLODs() - 1 : LODIndex;
+        for (int32 LOD = FirstLOD; LOD <= LastLOD; LOD++)
+        {
+            FWorldPaintJob Job;
+            Job.StaticMeshComponent = CandidateComponent;
+            Job.LODIndex = LOD;
+            if (ValidateMeshForPainting(CandidateComponent, LOD, Job.VertexNum))
+            {
+                Jobs.Add(Job);
+            }
+        }
+    }
+    
+    // Evaluate all components in parallel
+    ParallelFor(Jobs.Num(), [&Jobs, &Parameters](int32 JobIndex)
+    {
+        FWorldPaintJob& Job = Jobs[JobIndex];
+        
+        TArray<FColor> VertexColors;
+        ReadVertexColors(Job.StaticMeshComponent, Job.LODIndex, Job.VertexNum, VertexColors);
+        
+        // Evaluate in world space, so scaled components are painted with the same shape that was queried
+        const FPositionVertexBuffer& VertexPositionBuffer = Job.StaticMeshComponent->GetStaticMesh()->GetRenderData()->LODResources[Job.LODIndex].VertexBuffers.PositionVertexBuffer;
+        const FTransform& ComponentTransform = Job.StaticMeshComponent->GetComponentTransform();
+        const bool bAnyVertexPainted = PaintRegionColors(
+            Job.VertexNum,
+            [&VertexPositionBuffer, &ComponentTransform](int32 VertexIndex) { return ComponentTransform.TransformPosition(FVector(VertexPositionBuffer.VertexPosition(VertexIndex))); },
+            FTransform::Identity,
+            Parameters.PaintShape,
+            Parameters.Location,
+            Parameters.Dimensions,
+            Parameters.Rotation,
+            Parameters.Color,
+            Parameters.BlendMode,
+            Parameters.BlendStrength,
+            Parameters.Falloff,
+            VertexColors
+        );
+        
+        if (bAnyVertexPainted)
+        {
+            Job.VertexColors = new FColorVertexBuffer;
+            Job.VertexColors->InitFromColorArray(VertexColors);
+        }
+    });
+    
+    // Commit all uploads as one batch
+    TArray<FVertexPaintColorUpload> Uploads;
+    for (const FWorldPaintJob& Job : Jobs)
+    {
+        if (Job.VertexColors)
+        {
+            FVertexPaintColorUpload& Upload = Uploads.AddDefaulted_GetRef();
+            Upload.StaticMeshComponent = Job.StaticMeshComponent;
+            Upload.LODIndex = Job.LODIndex;
+            Upload.VertexColors = Job.VertexColors;
+            
+            PaintedComponents.AddUnique(Job.StaticMeshComponent);
+        }
+    }
+    
+    ApplyColorVertexBuffers(Uploads);
+    
+    return PaintedComponents;
+}
+
+bool UVertexBlueprintFunctionLibrary::PaintSkeletalMeshRegion(USkeletalMeshComponent* SkeletalMeshComponent, const FVertexPaintParameters& Parameters, int32 LODIndex)
+{
+    if (!SkeletalMeshComponent || !SkeletalMeshComponent->GetSkeletalMeshRenderData())
+    {
+        UE_LOG(LogTemp, Warning, TEXT("VertexPaint: Invalid SkeletalMeshComponent"));
+        return false;
+    }
+    
+    if (Parameters.bApplyToAllLODs)
+    {
+        // Paint all LODs
+        bool bSuccess = false;
+        const int32 LODCount = SkeletalMeshComponent->GetSkeletalMeshRenderData()->LODRenderData.Num();
+        
+        for (int32 LOD = 0; LOD < LODCount; LOD++)
+        {
+            bSuccess |= PaintSkeletalMeshLOD(SkeletalMeshComponent, Parameters, LOD);
+        }
+        
+        return bSuccess;
+    }
+    
+    return PaintSkeletalMeshLOD(SkeletalMeshComponent, Parameters, LODIndex);
+}
+
+bool UVertexBlueprintFunctionLibrary::PaintSkeletalMeshLOD(USkeletalMeshComponent* SkeletalMeshComponent, const FVertexPaintParameters& Parameters, int32 LODIndex)
+{
+    const FSkeletalMeshRenderData* RenderData = SkeletalMeshComponent->GetSkeletalMeshRenderData();
+    if (!RenderData->LODRenderData.IsValidIndex(LODIndex))
+    {
+        UE_LOG(LogTemp, Warning, TEXT("VertexPaint: Invalid LOD index: %d, Max: %d"), LODIndex, RenderData->LODRenderData.Num() - 1);
+        return false;
+    }
+    
+    // Component space positions in the current pose, shared by all strokes of this frame
+    const TSharedPtr<const FVertexPaintSkinnedPositions> SkinnedPositions = FVertexPaintSkinnedPositionCache::Get(SkeletalMeshComponent, LODIndex);
+    if (!SkinnedPositions.IsValid())
+    {
+        return false;
+    }
+    
+    // Get current colors
+    const FSkeletalMeshLODRenderData& LODData = RenderData->LODRenderData[LODIndex];
+    const int32 VertexNum = SkinnedPositions->SkinnedPositions.Num();
+    TArray<FColor> VertexColors;
+    VertexColors.Init(FColor::White, VertexNum);
+    
+    if (SkeletalMeshComponent->LODInfo.IsValidIndex(LODIndex) && SkeletalMeshComponent->LODInfo[LODIndex].OverrideVertexColors)
+    {
+        SkeletalMeshComponent->LODInfo[LODIndex].OverrideVertexColors->GetVertexColors(VertexColors);
+    }
+    else if (static_cast<int32>(LODData.StaticVertexBuffers.ColorVertexBuffer.GetNumVertices()) == VertexNum)
+    {
+        LODData.StaticVertexBuffers.ColorVertexBuffer.GetVertexColors(VertexColors);
+    }
+    
+    const bool bAnyVertexPainted = PaintRegionColors(
+        SkinnedPositions->SkinnedPositions,
+        SkeletalMeshComponent->GetComponentTransform(),
+        Parameters.PaintShape,
+        Parameters.Location,
+        Parameters.Dimensions,
+        Parameters.Rotation,
+        Parameters.Color,
+        Parameters.BlendMode,
+        Parameters.BlendStrength,
+        Parameters.Falloff,
+        VertexColors
+    );
+    
+    if (bAnyVertexPainted)
+    {
+        SkeletalMeshComponent->SetVertexColorOverride(LODIndex, VertexColors);
+    }
+    
+    return bAnyVertexPainted;
+}
+
 FVertexPaintUndoRedoState UVertexBlueprintFunctionLibrary::SaveVertexColorsState(UStaticMeshComponent* StaticMeshComponent, int32 LODIndex)
 {
     FVertexPaintUndoRedoState State;
@@ -0,0 +1,218 @@
+// Copyright (C) Thyke. All Rights Reserved.
+
+#include "VertexBlueprintFunctionLibrary.h"
+#include "VertexPaintMeshAdjacency.h"
+#include "VertexPaintMeshData.h"
+#include "VertexPaintSkinnedPositionCache.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Rendering/SkeletalMeshLODRenderData.h"
+#include "Rendering/SkeletalMeshRenderData.h"
+#include "StaticMeshResources.h"
+#include "UObject/UObjectIterator.h"
+
+/**
+ * Console benchmarks, a friend of the function library so they can time its internal steps
+ */
+struct FVertexPaintBenchmarks
+{
+    /**
+     * Compares the time to first paint of loaded static meshes that have Vertex Paint Mesh Data: the adjacency
+     * cache path taken by the first paint (baked data, waiting for it to stream in if needed) against building
+     * the adjacency at runtime. Both end with the same adjacency walk on LOD 0. Meshes whose baked data did not
+     * match LOD 0 are reported, as their first paint fell back to the runtime builder.
+     */
+    static void BenchmarkMeshData(const TArray<FString>& Args)
+    {
+        const FString NameFilter = Args.Num() > 0 ? Args[0] : FString();
+
+        int32 MeshNum = 0;
+        int32 FallbackMeshNum = 0;
+        double TotalRuntimeSeconds = 0.0;
+        double TotalBakedSeconds = 0.0;
+
+        for (TObjectIterator<UStaticMesh> It; It; ++It)
+        {
+            UStaticMesh* StaticMesh = *It;
+            const FStaticMeshRenderData* RenderData = StaticMesh->GetRenderData();
+            UVertexPaintMeshData* MeshData = StaticMesh->GetAssetUserData<UVertexPaintMeshData>();
+            if (!MeshData || !RenderData || RenderData->LODResources.Num() == 0 || (!NameFilter.IsEmpty() && !StaticMesh->GetName().Contains(NameFilter)))
+            {
+                continue;
+            }
+
+            const FStaticMeshLODResources& LODResources = RenderData->LODResources[0];
+            if (LODResources.GetNumTriangles() == 0 || LODResources.IndexBuffer.GetNumIndices() == 0)
+            {
+                continue;
+            }
+
+            // Same brush for both paths: a tenth of the mesh size around the first triangle
+            const FPositionVertexBuffer& Positions = LODResources.VertexBuffers.PositionVertexBuffer;
+            const FVector Center = FVector(Positions.VertexPosition(LODResources.IndexBuffer.GetIndex(0)));
+            const float Radius = FMath::Max(1.0f, static_cast<float>(RenderData->Bounds.SphereRadius) * 0.1f);
+            TArray<int32> PaintedVertices;
+            TArray<float> PaintedDistances;
+
+            // Runtime-built
+            const double RuntimeStart = FPlatformTime::Seconds();
+            const TSharedPtr<FVertexPaintMeshAdjacency> RuntimeAdjacency = FVertexPaintMeshAdjacency::Build(StaticMesh, 0);
+            RuntimeAdjacency->CollectVerticesInRadius(Positions, 0, Center, Radius, PaintedVertices, PaintedDistances);
+            const double RuntimeSeconds = FPlatformTime::Seconds() - RuntimeStart;
+
+            PaintedVertices.Reset();
+            PaintedDistances.Reset();
+
+            // Baked, through the same cache lookup as the first paint
+            FVertexPaintMeshAdjacencyCache::Remove(StaticMesh);
+            const double BakedStart = FPlatformTime::Seconds();
+            const TSharedPtr<const FVertexPaintMeshAdjacency> CachedAdjacency = FVertexPaintMeshAdjacencyCache::Get(StaticMesh, 0);
+            CachedAdjacency->CollectVerticesInRadius(Positions, 0, Center, Radius, PaintedVertices, PaintedDistances);
+            const double BakedSeconds = FPlatformTime::Seconds() - BakedStart;
+
+            const TSharedPtr<const FVertexPaintMeshAdjacency> BakedAdjacency = MeshData->FindBakedAdjacency(LODResources.GetNumVertices(), LODResources.IndexBuffer.GetNumIndices());
+            if (!BakedAdjacency.IsValid() || BakedAdjacency != CachedAdjacency)
+            {
+                UE_LOG(LogTemp, Warning, TEXT("VertexPaint: %s has no baked paint data matching LOD 0, first paint used the runtime builder (%.3f ms)"),
+                    *StaticMesh->GetName(), BakedSeconds * 1000.0);
+                FallbackMeshNum++;
+                continue;
+            }
+
+            UE_LOG(LogTemp, Display, TEXT("VertexPaint: %s (%d vertices): runtime-built %.3f ms, baked %.3f ms"),
+                *StaticMesh->GetName(), LODResources.GetNumVertices(), RuntimeSeconds * 1000.0, BakedSeconds * 1000.0);
+
+            MeshNum++;
+            TotalRuntimeSeconds += RuntimeSeconds;
+            TotalBakedSeconds += BakedSeconds;
+        }
+
+        UE_LOG(LogTemp, Display, TEXT("VertexPaint: Time to first paint over %d meshes with baked data: runtime-built %.3f ms, baked %.3f ms; %d meshes fell back to the runtime builder"),
+            MeshNum, TotalRuntimeSeconds * 1000.0, TotalBakedSeconds * 1000.0, FallbackMeshNum);
+    }
+
+    /**
+     * Compares paint strokes on every skeletal mesh component in the world with the cached skinned positions, as used
+     * by Paint Skeletal Mesh Region, against full CPU skinning on every stroke. Both arms run the same brush test
+     * for every stroke, over two frames: the first includes building the cache, and in the second a tenth of the
+     * bones that skin vertices moved.
+     */
+    static void BenchmarkSkinnedPaint(const TArray<FString>& Args, UWorld* World)
+    {
+        const int32 StrokeNum = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 8;
+        static constexpr int32 FrameNum = 2;
+
+        for (TObjectIterator<USkeletalMeshComponent> It; It; ++It)
+        {
+            USkeletalMeshComponent* SkeletalMeshComponent = *It;
+            const FSkeletalMeshRenderData* RenderData = SkeletalMeshComponent->GetSkeletalMeshRenderData();
+            const FSkinWeightVertexBuffer* SkinWeightBuffer = SkeletalMeshComponent->GetSkinWeightBuffer(0);
+            if (SkeletalMeshComponent->GetWorld() != World || !SkeletalMeshComponent->IsRegistered() || !RenderData || RenderData->LODRenderData.Num() == 0 || !SkinWeightBuffer)
+            {
+                continue;
+            }
+
+            // Only used to pick the moved bones, outside the timed sections
+            const TSharedPtr<FVertexPaintSkinnedPositions> Layout = FVertexPaintSkinnedPositions::Build(SkeletalMeshComponent, 0);
+            if (!Layout.IsValid())
+            {
+                continue;
+            }
+
+            int32 SkinningBoneNum = 0;
+            TArray<int32> MovedBones;
+            for (int32 BoneIndex = 0; BoneIndex < Layout->BoneVertexOffsets.Num() - 1; BoneIndex++)
+            {
+                if (Layout->BoneVertexOffsets[BoneIndex + 1] > Layout->BoneVertexOffsets[BoneIndex] && SkinningBoneNum++ % 10 == 0)
+                {
+                    MovedBones.Add(BoneIndex);
+                }
+            }
+
+            auto GetFrameRefToLocals = [SkeletalMeshComponent, &MovedBones](int32 Frame, TArray<FMatrix44f>& OutRefToLocals)
+            {
+                SkeletalMeshComponent->CacheRefToLocalMatrices(OutRefToLocals);
+                if (Frame > 0)
+                {
+                    for (const int32 BoneIndex : MovedBones)
+                    {
+                        if (OutRefToLocals.IsValidIndex(BoneIndex))
+                        {
+                            OutRefToLocals[BoneIndex].SetOrigin(OutRefToLocals[BoneIndex].GetOrigin() + FVector3f(0.0f, 0.0f, 1.0f));
+                        }
+                    }
+                }
+            };
+
+            // Same brush for both arms: a tenth of the component size around its bounds origin
+            const FTransform& ComponentTransform = SkeletalMeshComponent->GetComponentTransform();
+            const FVector BrushLocation = SkeletalMeshComponent->Bounds.Origin;
+            const FVector BrushDimensions = FVector(FMath::Max(1.0, SkeletalMeshComponent->Bounds.SphereRadius * 0.1));
+            TArray<FColor> VertexColors;
+
+            auto PaintStroke = [&](TConstArrayView<FVector3f> VertexPositions)
+            {
+                UVertexBlueprintFunctionLibrary::PaintRegionColors(VertexPositions, ComponentTransform, EVertexPaintShape::Sphere, BrushLocation, BrushDimensions,
+                    FRotator::ZeroRotator, FLinearColor::Red, EVertexColorBlendMode::Add, 0.1f, 0.5f, VertexColors);
+            };
+
+            // Full skinning on every stroke
+            double FullSeconds[FrameNum] = {};
+            TArray<FVector3f> FullPositions;
+            VertexColors.Init(FColor::White, Layout->RefPositions.Num());
+            for (int32 Frame = 0; Frame < FrameNum; Frame++)
+            {
+                const double FullStart = FPlatformTime::Seconds();
+                for (int32 Stroke = 0; Stroke < StrokeNum; Stroke++)
+                {
+                    TArray<FMatrix44f> RefToLocals;
+                    GetFrameRefToLocals(Frame, RefToLocals);
+                    USkinnedMeshComponent::ComputeSkinnedPositions(SkeletalMeshComponent, FullPositions, RefToLocals, RenderData->LODRenderData[0], *SkinWeightBuffer);
+                    PaintStroke(FullPositions);
+                }
+                FullSeconds[Frame] = FPlatformTime::Seconds() - FullStart;
+            }
+
+            // Cached, through the same cache lookup as the paint functions, starting cold. Frame numbers ahead
+            // of the engine's are used, and the entry is dropped afterwards so real strokes don't see moved bones.
+            double CachedSeconds[FrameNum] = {};
+            const uint64 FirstFrame = GFrameCounter + 1;
+            FVertexPaintSkinnedPositionCache::Remove(SkeletalMeshComponent);
+            VertexColors.Init(FColor::White, Layout->RefPositions.Num());
+            for (int32 Frame = 0; Frame < FrameNum; Frame++)
+            {
+                const double CachedStart = FPlatformTime::Seconds();
+                for (int32 Stroke = 0; Stroke < StrokeNum; Stroke++)
+                {
+                    const TSharedPtr<const FVertexPaintSkinnedPositions> CachedPositions = FVertexPaintSkinnedPositionCache::Get(SkeletalMeshComponent, 0, FirstFrame + Frame,
+                        [&GetFrameRefToLocals, Frame](TArray<FMatrix44f>& OutRefToLocals) { GetFrameRefToLocals(Frame, OutRefToLocals); });
+                    if (CachedPositions.IsValid())
+                    {
+                        PaintStroke(CachedPositions->SkinnedPositions);
+                    }
+                }
+                CachedSeconds[Frame] = FPlatformTime::Seconds() - CachedStart;
+            }
+            FVertexPaintSkinnedPositionCache::Remove(SkeletalMeshComponent);
+
+            UE_LOG(LogTemp, Display, TEXT("VertexPaint: %s (%d vertices), %d strokes per frame: first frame with full skinning %.3f ms, cached %.3f ms (including build); next frame with %d of %d skinning bones moved: full %.3f ms, cached %.3f ms"),
+                *SkeletalMeshComponent->GetPathName(), Layout->RefPositions.Num(), StrokeNum,
+                FullSeconds[0] * 1000.0, CachedSeconds[0] * 1000.0, MovedBones.Num(), SkinningBoneNum, FullSeconds[1] * 1000.0, CachedSeconds[1] * 1000.0);
+        }
+    }
+};
+
+namespace VertexPaintBenchmarks
+{
+    static FAutoConsoleCommand BenchmarkSkinnedPaintCommand(
+        TEXT("VertexPaint.BenchmarkSkinnedPaint"),
+        TEXT("Compares skeletal mesh paint strokes using cached skinned positions against full skinning per stroke. Usage: VertexPaint.BenchmarkSkinnedPaint [StrokeCount]"),
+        FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&FVertexPaintBenchmarks::BenchmarkSkinnedPaint));
+
+    static FAutoConsoleCommand BenchmarkMeshDataCommand(
+        TEXT("VertexPaint.BenchmarkMeshData"),
+        TEXT("Compares time to first paint of meshes with Vertex Paint Mesh Data using baked and runtime-built paint data. Usage: VertexPaint.BenchmarkMeshData [MeshNameFilter]"),
+        FConsoleCommandWithArgsDelegate::CreateStatic(&FVertexPaintBenchmarks::BenchmarkMeshData));
+}
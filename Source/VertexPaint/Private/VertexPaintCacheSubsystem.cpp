@@ -0,0 +1,502 @@
+// Copyright (C) Thyke. All Rights Reserved.
+
+#include "VertexPaintCacheSubsystem.h"
+#include "VertexBlueprintFunctionLibrary.h"
+#include "Async/Async.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/Level.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Hash/CityHash.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Rendering/ColorVertexBuffer.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "StaticMeshComponentLODInfo.h"
+
+#include UE_INLINE_GENERATED_CPP_BY_NAME(VertexPaintCacheSubsystem)
+
+static TAutoConsoleVariable<int32> CVarVertexPaintCacheMemoryBudgetMB(
+    TEXT("VertexPaint.CacheMemoryBudgetMB"),
+    32,
+    TEXT("Maximum size in megabytes of compressed paint kept in memory by the paint cache. Older entries are only kept on disk."));
+
+namespace VertexPaintCache
+{
+    static constexpr uint32 FileMagic = 0x31435056; // 'VPC1'
+    static constexpr int32 FileVersion = 1;
+    static const TCHAR* FileExtension = TEXT(".vpc");
+
+    static uint64 GetRecordId(const FString& ComponentPath)
+    {
+        const FTCHARToUTF8 ComponentPathUTF8(*ComponentPath);
+        return CityHash64(ComponentPathUTF8.Get(), ComponentPathUTF8.Length());
+    }
+}
+
+/**
+ * Paint of a single component, stored per painted LOD
+ */
+struct FVertexPaintCacheRecord
+{
+    FString ComponentPath;
+    TArray<int32> LODIndices;
+    TArray<TArray<FColor>> LODColors;
+
+    friend FArchive& operator<<(FArchive& Ar, FVertexPaintCacheRecord& Record)
+    {
+        uint32 Magic = VertexPaintCache::FileMagic;
+        int32 Version = VertexPaintCache::FileVersion;
+        Ar << Magic;
+        Ar << Version;
+        if (Ar.IsLoading() && (Magic != VertexPaintCache::FileMagic || Version != VertexPaintCache::FileVersion))
+        {
+            Ar.SetError();
+            return Ar;
+        }
+
+        Ar << Record.ComponentPath;
+
+        int32 LODNum = Record.LODIndices.Num();
+        Ar << LODNum;
+        if (Ar.IsLoading())
+        {
+            if (LODNum < 0 || LODNum > MAX_STATIC_MESH_LODS)
+            {
+                Ar.SetError();
+                return Ar;
+            }
+            Record.LODIndices.SetNum(LODNum);
+            Record.LODColors.SetNum(LODNum);
+        }
+
+        for (int32 LOD = 0; LOD < LODNum && !Ar.IsError(); LOD++)
+        {
+            Ar << Record.LODIndices[LOD];
+
+            int32 VertexNum = Record.LODColors[LOD].Num();
+            Ar << VertexNum;
+            if (Ar.IsLoading())
+            {
+                if (VertexNum < 0)
+                {
+                    Ar.SetError();
+                    return Ar;
+                }
+                Record.LODColors[LOD].SetNumUninitialized(VertexNum);
+            }
+
+            if (VertexNum > 0)
+            {
+                Ar.SerializeCompressedNew(Record.LODColors[LOD].GetData(), VertexNum * sizeof(FColor), NAME_Oodle, NAME_Oodle);
+            }
+        }
+
+        return Ar;
+    }
+};
+
+/**
+ * Cache state shared with worker tasks, which may outlive the subsystem
+ */
+struct FVertexPaintCacheStorage
+{
+    struct FMemoryEntry
+    {
+        TArray<uint8> Blob;
+        uint64 LastAccess = 0;
+    };
+
+    FString CacheDirectory;
+
+    FCriticalSection Lock;
+
+    /** Captured paint whose save task has not finished yet */
+    TMap<uint64, TSharedPtr<FVertexPaintCacheRecord, ESPMode::ThreadSafe>> PendingRecords;
+
+    /** Compressed paint, evicted least recently used first once over budget */
+    TMap<uint64, FMemoryEntry> MemoryEntries;
+    int64 MemoryBytes = 0;
+    uint64 AccessCounter = 0;
+
+    /** Paint saved to the cache directory */
+    TSet<uint64> DiskEntries;
+
+    FString GetFilePath(uint64 Id) const
+    {
+        return CacheDirectory / FString::Printf(TEXT("%016llx%s"), Id, VertexPaintCache::FileExtension);
+    }
+
+    bool Contains(uint64 Id)
+    {
+        FScopeLock ScopeLock(&Lock);
+        return PendingRecords.Contains(Id) || MemoryEntries.Contains(Id) || DiskEntries.Contains(Id);
+    }
+
+    /** Lock must be held */
+    void AddToMemory(uint64 Id, TArray<uint8>&& Blob)
+    {
+        FMemoryEntry& Entry = MemoryEntries.FindOrAdd(Id);
+        MemoryBytes += Blob.Num() - Entry.Blob.Num();
+        Entry.Blob = MoveTemp(Blob);
+        Entry.LastAccess = ++AccessCounter;
+
+        const int64 MemoryBudget = int64(FMath::Max(0, CVarVertexPaintCacheMemoryBudgetMB.GetValueOnAnyThread())) * 1024 * 1024;
+        while (MemoryBytes > MemoryBudget && MemoryEntries.Num() > 0)
+        {
+            uint64 OldestId = 0;
+            uint64 OldestAccess = MAX_uint64;
+            for (const TPair<uint64, FMemoryEntry>& MemoryEntry : MemoryEntries)
+            {
+                if (MemoryEntry.Value.LastAccess < OldestAccess)
+                {
+                    OldestId = MemoryEntry.Key;
+                    OldestAccess = MemoryEntry.Value.LastAccess;
+                }
+            }
+
+            MemoryBytes -= MemoryEntries[OldestId].Blob.Num();
+            MemoryEntries.Remove(OldestId);
+        }
+    }
+
+    /**
+     * Compresses captured paint and stores it in memory and on disk, unless a newer capture replaced it meanwhile.
+     * Commits run one at a time, so a newer capture of the same component is always written last.
+     */
+    void Commit(uint64 Id, const TSharedRef<FVertexPaintCacheRecord, ESPMode::ThreadSafe>& Record)
+    {
+        auto IsCurrentRecord = [this, Id, &Record]()
+        {
+            const TSharedPtr<FVertexPaintCacheRecord, ESPMode::ThreadSafe>* PendingRecord = PendingRecords.Find(Id);
+            return PendingRecord && PendingRecord->Get() == &Record.Get();
+        };
+
+        {
+            FScopeLock ScopeLock(&Lock);
+            if (!IsCurrentRecord())
+            {
+                return;
+            }
+        }
+
+        TArray<uint8> Blob;
+        FMemoryWriter Writer(Blob);
+        Writer << *Record;
+
+        // Disk IO stays outside the lock, the game thread queries it while levels stream in
+        const FString TempFilePath = FPaths::CreateTempFilename(*CacheDirectory, TEXT("VertexPaint"), TEXT(".tmp"));
+        const bool bWritten = FFileHelper::SaveArrayToFile(Blob, *TempFilePath) && IFileManager::Get().Move(*GetFilePath(Id), *TempFilePath, true, true);
+        if (!bWritten)
+        {
+            IFileManager::Get().Delete(*TempFilePath, false, false, true);
+            UE_LOG(LogTemp, Warning, TEXT("VertexPaint: Failed to write paint cache for %s"), *Record->ComponentPath);
+        }
+
+        FScopeLock ScopeLock(&Lock);
+        if (bWritten)
+        {
+            DiskEntries.Add(Id);
+        }
+
+        // A newer capture queued meanwhile is committed next and replaces the file again
+        if (IsCurrentRecord())
+        {
+            PendingRecords.Remove(Id);
+            AddToMemory(Id, MoveTemp(Blob));
+        }
+    }
+
+    /**
+     * Finds the paint of a component in pending captures, memory or disk. Called from worker threads.
+     */
+    TSharedPtr<FVertexPaintCacheRecord, ESPMode::ThreadSafe> Load(uint64 Id, const FString& ComponentPath)
+    {
+        TArray<uint8> Blob;
+        {
+            FScopeLock ScopeLock(&Lock);
+            if (const TSharedPtr<FVertexPaintCacheRecord, ESPMode::ThreadSafe>* PendingRecord = PendingRecords.Find(Id))
+            {
+                return *PendingRecord;
+            }
+
+            if (FMemoryEntry* Entry = MemoryEntries.Find(Id))
+            {
+                Entry->LastAccess = ++AccessCounter;
+                Blob = Entry->Blob;
+            }
+        }
+
+        if (Blob.Num() == 0)
+        {
+            if (!FFileHelper::LoadFileToArray(Blob, *GetFilePath(Id), FILEREAD_Silent))
+            {
+                return nullptr;
+            }
+
+            FScopeLock ScopeLock(&Lock);
+            AddToMemory(Id, CopyTemp(Blob));
+        }
+
+        TSharedPtr<FVertexPaintCacheRecord, ESPMode::ThreadSafe> Record = MakeShared<FVertexPaintCacheRecord, ESPMode::ThreadSafe>();
+        FMemoryReader Reader(Blob);
+        Reader << *Record;
+
+        // Guard against corrupt files and hash collisions
+        if (Reader.IsError() || Record->ComponentPath != ComponentPath)
+        {
+            return nullptr;
+        }
+
+        return Record;
+    }
+};
+
+bool UVertexPaintCacheSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+    return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UVertexPaintCacheSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+    Super::Initialize(Collection);
+
+    Storage = MakeShared<FVertexPaintCacheStorage, ESPMode::ThreadSafe>();
+    Storage->CacheDirectory = FPaths::ProjectSavedDir() / TEXT("VertexPaintCache");
+    IFileManager::Get().MakeDirectory(*Storage->CacheDirectory, true);
+
+    // Index paint saved by previous sessions
+    TArray<FString> CacheFileNames;
+    IFileManager::Get().FindFiles(CacheFileNames, *(Storage->CacheDirectory / FString(TEXT("*")) + VertexPaintCache::FileExtension), true, false);
+    for (const FString& CacheFileName : CacheFileNames)
+    {
+        Storage->DiskEntries.Add(FCString::Strtoui64(*FPaths::GetBaseFilename(CacheFileName), nullptr, 16));
+    }
+
+    PreLevelRemovedHandle = FWorldDelegates::PreLevelRemovedFromWorld.AddUObject(this, &UVertexPaintCacheSubsystem::HandlePreLevelRemovedFromWorld);
+    LevelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &UVertexPaintCacheSubsystem::HandleLevelAddedToWorld);
+}
+
+void UVertexPaintCacheSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+    Super::OnWorldBeginPlay(InWorld);
+
+    // Level Added To World is only broadcast for streamed levels, restore the persistent level
+    // (including World Partition always loaded actors) here
+    HandleLevelAddedToWorld(InWorld.PersistentLevel, &InWorld);
+}
+
+void UVertexPaintCacheSubsystem::Deinitialize()
+{
+    FWorldDelegates::PreLevelRemovedFromWorld.Remove(PreLevelRemovedHandle);
+    FWorldDelegates::LevelAddedToWorld.Remove(LevelAddedHandle);
+
+    // Persist paint of everything still loaded, so it is available next session; the persistent
+    // level is restored on begin play and streamed levels when they are added
+    for (const TPair<TWeakObjectPtr<UStaticMeshComponent>, uint32>& PaintedComponent : PaintedComponents)
+    {
+        SaveComponentPaint(PaintedComponent.Key.Get());
+    }
+    PaintedComponents.Empty();
+
+    UE::Tasks::Wait(PendingTasks);
+    PendingTasks.Empty();
+
+    Super::Deinitialize();
+}
+
+void UVertexPaintCacheSubsystem::NotifyComponentPainted(UStaticMeshComponent* StaticMeshComponent)
+{
+    PaintedComponents.FindOrAdd(StaticMeshComponent)++;
+}
+
+uint32 UVertexPaintCacheSubsystem::GetPaintGeneration(const UStaticMeshComponent* StaticMeshComponent) const
+{
+    const uint32* PaintGeneration = PaintedComponents.Find(MakeWeakObjectPtr(const_cast<UStaticMeshComponent*>(StaticMeshComponent)));
+    return PaintGeneration ? *PaintGeneration : 0;
+}
+
+bool UVertexPaintCacheSubsystem::SaveComponentPaint(UStaticMeshComponent* StaticMeshComponent)
+{
+    if (!StaticMeshComponent || !StaticMeshComponent->GetStaticMesh())
+    {
+        return false;
+    }
+
+    // Capture on the game thread, compress and write on a worker
+    TSharedRef<FVertexPaintCacheRecord, ESPMode::ThreadSafe> Record = MakeShared<FVertexPaintCacheRecord, ESPMode::ThreadSafe>();
+    Record->ComponentPath = GetStableComponentPath(StaticMeshComponent);
+
+    for (int32 LODIndex = 0; LODIndex < StaticMeshComponent->LODData.Num(); LODIndex++)
+    {
+        const FColorVertexBuffer* OverrideVertexColors = StaticMeshComponent->LODData[LODIndex].OverrideVertexColors;
+        if (OverrideVertexColors && OverrideVertexColors->GetNumVertices() > 0)
+        {
+            Record->LODIndices.Add(LODIndex);
+            OverrideVertexColors->GetVertexColors(Record->LODColors.AddDefaulted_GetRef());
+        }
+    }
+
+    if (Record->LODIndices.Num() == 0)
+    {
+        return false;
+    }
+
+    const uint64 Id = VertexPaintCache::GetRecordId(Record->ComponentPath);
+    {
+        FScopeLock ScopeLock(&Storage->Lock);
+        Storage->PendingRecords.Add(Id, Record);
+    }
+
+    AddPendingTask(CommitPipe.Launch(UE_SOURCE_LOCATION, [Storage = Storage, Id, Record]()
+    {
+        Storage->Commit(Id, Record);
+    }));
+
+    return true;
+}
+
+bool UVertexPaintCacheSubsystem::RestoreComponentPaint(UStaticMeshComponent* StaticMeshComponent)
+{
+    if (!StaticMeshComponent || !StaticMeshComponent->GetStaticMesh())
+    {
+        return false;
+    }
+
+    const FString ComponentPath = GetStableComponentPath(StaticMeshComponent);
+    const uint64 Id = VertexPaintCache::GetRecordId(ComponentPath);
+    if (!Storage->Contains(Id))
+    {
+        return false;
+    }
+
+    // Paint applied to the component after this point wins over the cached paint
+    const uint32 RequestPaintGeneration = GetPaintGeneration(StaticMeshComponent);
+
+    AddPendingTask(UE::Tasks::Launch(UE_SOURCE_LOCATION, [Storage = Storage, Id, ComponentPath, WeakComponent = TWeakObjectPtr<UStaticMeshComponent>(StaticMeshComponent), WeakThis = TWeakObjectPtr<UVertexPaintCacheSubsystem>(this), RequestPaintGeneration]()
+    {
+        const TSharedPtr<FVertexPaintCacheRecord, ESPMode::ThreadSafe> Record = Storage->Load(Id, ComponentPath);
+        if (!Record.IsValid())
+        {
+            return;
+        }
+
+        // Build the CPU side of the color buffers here, so the game thread only has to swap them in
+        TArray<TPair<int32, TUniquePtr<FColorVertexBuffer>>> RestoredLODs;
+        for (int32 LOD = 0; LOD < Record->LODIndices.Num(); LOD++)
+        {
+            TUniquePtr<FColorVertexBuffer> VertexColors = MakeUnique<FColorVertexBuffer>();
+            VertexColors->InitFromColorArray(Record->LODColors[LOD]);
+            RestoredLODs.Emplace(Record->LODIndices[LOD], MoveTemp(VertexColors));
+        }
+
+        AsyncTask(ENamedThreads::GameThread, [WeakComponent, WeakThis, RequestPaintGeneration, RestoredLODs = MoveTemp(RestoredLODs)]() mutable
+        {
+            UStaticMeshComponent* RestoredComponent = WeakComponent.Get();
+            const UVertexPaintCacheSubsystem* PaintCache = WeakThis.Get();
+            if (!RestoredComponent || !PaintCache)
+            {
+                return;
+            }
+
+            if (PaintCache->GetPaintGeneration(RestoredComponent) != RequestPaintGeneration)
+            {
+                UE_LOG(LogTemp, Verbose, TEXT("VertexPaint: Skipping cached paint of %s - it was painted while restoring"), *RestoredComponent->GetPathName());
+                return;
+            }
+
+            for (TPair<int32, TUniquePtr<FColorVertexBuffer>>& RestoredLOD : RestoredLODs)
+            {
+                int32 VertexNum = 0;
+                if (!UVertexBlueprintFunctionLibrary::ValidateMeshForPainting(RestoredComponent, RestoredLOD.Key, VertexNum)
+                    || VertexNum != static_cast<int32>(RestoredLOD.Value->GetNumVertices()))
+                {
+                    UE_LOG(LogTemp, Warning, TEXT("VertexPaint: Can't restore cached paint of %s - vertex count mismatch"), *RestoredComponent->GetPathName());
+                    continue;
+                }
+
+                UVertexBlueprintFunctionLibrary::ApplyColorVertexBuffer(RestoredComponent, RestoredLOD.Key, RestoredLOD.Value.Release());
+            }
+        });
+    }));
+
+    return true;
+}
+
+void UVertexPaintCacheSubsystem::ClearPaintCache()
+{
+    UE::Tasks::Wait(PendingTasks);
+    PendingTasks.Empty();
+
+    FScopeLock ScopeLock(&Storage->Lock);
+    Storage->PendingRecords.Empty();
+    Storage->MemoryEntries.Empty();
+    Storage->MemoryBytes = 0;
+    Storage->DiskEntries.Empty();
+
+    IFileManager::Get().DeleteDirectory(*Storage->CacheDirectory, false, true);
+    IFileManager::Get().MakeDirectory(*Storage->CacheDirectory, true);
+}
+
+void UVertexPaintCacheSubsystem::HandlePreLevelRemovedFromWorld(ULevel* Level, UWorld* World)
+{
+    if (World != GetWorld())
+    {
+        return;
+    }
+
+    for (TMap<TWeakObjectPtr<UStaticMeshComponent>, uint32>::TIterator It = PaintedComponents.CreateIterator(); It; ++It)
+    {
+        UStaticMeshComponent* PaintedComponent = It.Key().Get();
+        if (!PaintedComponent)
+        {
+            It.RemoveCurrent();
+        }
+        else if (PaintedComponent->GetComponentLevel() == Level)
+        {
+            SaveComponentPaint(PaintedComponent);
+            It.RemoveCurrent();
+        }
+    }
+}
+
+void UVertexPaintCacheSubsystem::HandleLevelAddedToWorld(ULevel* Level, UWorld* World)
+{
+    if (World != GetWorld() || !Level)
+    {
+        return;
+    }
+
+    for (AActor* Actor : Level->Actors)
+    {
+        if (Actor)
+        {
+            Actor->ForEachComponent<UStaticMeshComponent>(false, [this](UStaticMeshComponent* StaticMeshComponent)
+            {
+                RestoreComponentPaint(StaticMeshComponent);
+            });
+        }
+    }
+}
+
+FString UVertexPaintCacheSubsystem::GetStableComponentPath(const UStaticMeshComponent* StaticMeshComponent) const
+{
+    // World Partition cell packages are generated, but actor names are unique within the world.
+    // Regular streaming levels can reuse actor names, so those are scoped to their level package.
+    const ULevel* Level = StaticMeshComponent->GetComponentLevel();
+    const UObject* Scope = Level && !Level->IsWorldPartitionRuntimeCell() ? static_cast<const UObject*>(Level) : static_cast<const UObject*>(GetWorld());
+    const FString ScopePackage = UWorld::RemovePIEPrefix(Scope->GetOutermost()->GetName());
+
+    const AActor* Owner = StaticMeshComponent->GetOwner();
+    return FString::Printf(TEXT("%s:%s.%s"), *ScopePackage, Owner ? *Owner->GetName() : TEXT("None"), *StaticMeshComponent->GetName());
+}
+
+void UVertexPaintCacheSubsystem::AddPendingTask(UE::Tasks::FTask Task)
+{
+    PendingTasks.RemoveAll([](const UE::Tasks::FTask& PendingTask) { return PendingTask.IsCompleted(); });
+    PendingTasks.Add(MoveTemp(Task));
+}
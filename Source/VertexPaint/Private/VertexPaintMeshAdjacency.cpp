@@ -0,0 +1,275 @@
+// Copyright (C) Thyke. All Rights Reserved.
+
+#include "VertexPaintMeshAdjacency.h"
+#include "VertexPaintMeshData.h"
+#include "Engine/StaticMesh.h"
+#include "StaticMeshResources.h"
+#include "UObject/UObjectGlobals.h"
+
+namespace VertexPaintMeshAdjacency
+{
+    static constexpr uint32 BlobMagic = 0x414D5056; // 'VPMA'
+    static constexpr int32 BlobVersion = 1;
+}
+
+FCriticalSection FVertexPaintMeshAdjacencyCache::CacheLock;
+TMap<TPair<TObjectKey<UStaticMesh>, int32>, FVertexPaintMeshAdjacencyCache::FEntry> FVertexPaintMeshAdjacencyCache::Cache;
+FDelegateHandle FVertexPaintMeshAdjacencyCache::PostGarbageCollectHandle;
+
+TSharedPtr<FVertexPaintMeshAdjacency> FVertexPaintMeshAdjacency::Build(const UStaticMesh* StaticMesh, int32 LODIndex)
+{
+    const FStaticMeshRenderData* RenderData = StaticMesh ? StaticMesh->GetRenderData() : nullptr;
+    if (!RenderData)
+    {
+        return nullptr;
+    }
+
+    return Build(StaticMesh, *RenderData, LODIndex);
+}
+
+TSharedPtr<FVertexPaintMeshAdjacency> FVertexPaintMeshAdjacency::Build(const UStaticMesh* StaticMesh, const FStaticMeshRenderData& RenderData, int32 LODIndex)
+{
+    if (!RenderData.LODResources.IsValidIndex(LODIndex))
+    {
+        return nullptr;
+    }
+
+    const FStaticMeshLODResources& LODResources = RenderData.LODResources[LODIndex];
+    const FPositionVertexBuffer& PositionBuffer = LODResources.VertexBuffers.PositionVertexBuffer;
+    const int32 VertexNum = PositionBuffer.GetNumVertices();
+
+    TSharedPtr<FVertexPaintMeshAdjacency> Adjacency = MakeShared<FVertexPaintMeshAdjacency>();
+    LODResources.IndexBuffer.GetCopy(Adjacency->Indices);
+
+    // Weld vertices sharing a position; render vertices are split wherever UVs or normals differ
+    TMap<FVector3f, int32> WeldedIdByPosition;
+    WeldedIdByPosition.Reserve(VertexNum);
+    Adjacency->WeldedVertexIds.SetNumUninitialized(VertexNum);
+    for (int32 VertexIndex = 0; VertexIndex < VertexNum; VertexIndex++)
+    {
+        const int32 NextId = WeldedIdByPosition.Num();
+        Adjacency->WeldedVertexIds[VertexIndex] = WeldedIdByPosition.FindOrAdd(PositionBuffer.VertexPosition(VertexIndex), NextId);
+    }
+
+    // Bucket triangles by welded vertex
+    const int32 WeldedNum = WeldedIdByPosition.Num();
+    const int32 TriangleNum = Adjacency->GetNumTriangles();
+    TArray<int32>& Offsets = Adjacency->WeldedVertexTriangleOffsets;
+    Offsets.SetNumZeroed(WeldedNum + 1);
+    for (const uint32 Index : Adjacency->Indices)
+    {
+        Offsets[Adjacency->WeldedVertexIds[Index] + 1]++;
+    }
+    for (int32 WeldedId = 0; WeldedId < WeldedNum; WeldedId++)
+    {
+        Offsets[WeldedId + 1] += Offsets[WeldedId];
+    }
+
+    TArray<int32> FillCursor(Offsets.GetData(), WeldedNum);
+    Adjacency->WeldedVertexTriangles.SetNumUninitialized(Adjacency->Indices.Num());
+    for (int32 TriangleIndex = 0; TriangleIndex < TriangleNum; TriangleIndex++)
+    {
+        for (int32 Corner = 0; Corner < 3; Corner++)
+        {
+            const int32 WeldedId = Adjacency->WeldedVertexIds[Adjacency->Indices[TriangleIndex * 3 + Corner]];
+            Adjacency->WeldedVertexTriangles[FillCursor[WeldedId]++] = TriangleIndex;
+        }
+    }
+
+    // Complex collision is cooked from the collision-enabled sections of this LOD, in section order
+    const int32 CollisionLODIndex = FMath::Clamp(StaticMesh->GetLODForCollision(), 0, RenderData.LODResources.Num() - 1);
+    if (CollisionLODIndex == LODIndex)
+    {
+        for (const FStaticMeshSection& Section : LODResources.Sections)
+        {
+            if (!Section.bEnableCollision)
+            {
+                continue;
+            }
+
+            const int32 FirstTriangle = Section.FirstIndex / 3;
+            for (uint32 SectionTriangle = 0; SectionTriangle < Section.NumTriangles; SectionTriangle++)
+            {
+                Adjacency->CollisionFaceToTriangle.Add(FirstTriangle + SectionTriangle);
+            }
+        }
+    }
+
+    return Adjacency;
+}
+
+bool FVertexPaintMeshAdjacency::SerializeLODs(FArchive& Ar, TArray<TSharedPtr<FVertexPaintMeshAdjacency>>& LODs)
+{
+    uint32 Magic = VertexPaintMeshAdjacency::BlobMagic;
+    int32 Version = VertexPaintMeshAdjacency::BlobVersion;
+    Ar << Magic;
+    Ar << Version;
+    if (Ar.IsLoading() && (Magic != VertexPaintMeshAdjacency::BlobMagic || Version != VertexPaintMeshAdjacency::BlobVersion))
+    {
+        return false;
+    }
+
+    int32 LODNum = LODs.Num();
+    Ar << LODNum;
+    if (Ar.IsLoading())
+    {
+        if (LODNum < 0 || LODNum > MAX_STATIC_MESH_LODS)
+        {
+            return false;
+        }
+        LODs.SetNum(LODNum);
+    }
+
+    for (TSharedPtr<FVertexPaintMeshAdjacency>& Adjacency : LODs)
+    {
+        if (Ar.IsLoading())
+        {
+            Adjacency = MakeShared<FVertexPaintMeshAdjacency>();
+        }
+
+        Adjacency->Indices.BulkSerialize(Ar);
+        Adjacency->WeldedVertexIds.BulkSerialize(Ar);
+        Adjacency->WeldedVertexTriangleOffsets.BulkSerialize(Ar);
+        Adjacency->WeldedVertexTriangles.BulkSerialize(Ar);
+        Adjacency->CollisionFaceToTriangle.BulkSerialize(Ar);
+
+        // Cheap consistency checks, the counts are matched against the render data before use
+        if (Ar.IsLoading()
+            && (Ar.IsError()
+                || Adjacency->Indices.Num() % 3 != 0
+                || Adjacency->WeldedVertexTriangles.Num() != Adjacency->Indices.Num()
+                || Adjacency->WeldedVertexTriangleOffsets.Num() == 0
+                || Adjacency->WeldedVertexTriangleOffsets.Last() != Adjacency->WeldedVertexTriangles.Num()))
+        {
+            return false;
+        }
+    }
+
+    return !Ar.IsError();
+}
+
+void FVertexPaintMeshAdjacency::CollectVerticesInRadius(const FPositionVertexBuffer& Positions, int32 SeedTriangle, const FVector& Center, float Radius, TArray<int32>& OutVertices, TArray<float>& OutDistances) const
+{
+    const double RadiusSquared = FMath::Square(Radius);
+
+    TSet<int32> VisitedTriangles;
+    TSet<uint32> VisitedVertices;
+    TArray<int32, TInlineAllocator<64>> PendingTriangles;
+
+    VisitedTriangles.Add(SeedTriangle);
+    PendingTriangles.Add(SeedTriangle);
+
+    while (PendingTriangles.Num() > 0)
+    {
+        const int32 TriangleIndex = PendingTriangles.Pop(EAllowShrinking::No);
+        const uint32* Corners = &Indices[TriangleIndex * 3];
+
+        const FVector CornerPositions[3] = {
+            FVector(Positions.VertexPosition(Corners[0])),
+            FVector(Positions.VertexPosition(Corners[1])),
+            FVector(Positions.VertexPosition(Corners[2]))
+        };
+
+        // The brush is used up once a triangle lies entirely outside it; the seed is always expanded
+        if (TriangleIndex != SeedTriangle)
+        {
+            const FVector ClosestPoint = FMath::ClosestPointOnTriangleToPoint(Center, CornerPositions[0], CornerPositions[1], CornerPositions[2]);
+            if (FVector::DistSquared(ClosestPoint, Center) > RadiusSquared)
+            {
+                continue;
+            }
+        }
+
+        for (int32 Corner = 0; Corner < 3; Corner++)
+        {
+            bool bVertexVisited = false;
+            VisitedVertices.Add(Corners[Corner], &bVertexVisited);
+            if (!bVertexVisited)
+            {
+                const float Distance = FVector::Dist(CornerPositions[Corner], Center);
+                if (Distance <= Radius)
+                {
+                    OutVertices.Add(Corners[Corner]);
+                    OutDistances.Add(Distance);
+                }
+            }
+
+            const int32 WeldedId = WeldedVertexIds[Corners[Corner]];
+            for (int32 Slot = WeldedVertexTriangleOffsets[WeldedId]; Slot < WeldedVertexTriangleOffsets[WeldedId + 1]; Slot++)
+            {
+                const int32 NeighbourTriangle = WeldedVertexTriangles[Slot];
+
+                bool bTriangleVisited = false;
+                VisitedTriangles.Add(NeighbourTriangle, &bTriangleVisited);
+                if (!bTriangleVisited)
+                {
+                    PendingTriangles.Add(NeighbourTriangle);
+                }
+            }
+        }
+    }
+}
+
+TSharedPtr<const FVertexPaintMeshAdjacency> FVertexPaintMeshAdjacencyCache::Get(UStaticMesh* StaticMesh, int32 LODIndex)
+{
+    if (!StaticMesh || !StaticMesh->GetRenderData())
+    {
+        return nullptr;
+    }
+
+    const TPair<TObjectKey<UStaticMesh>, int32> Key(StaticMesh, LODIndex);
+
+    FScopeLock Lock(&CacheLock);
+    if (!PostGarbageCollectHandle.IsValid())
+    {
+        PostGarbageCollectHandle = FCoreUObjectDelegates::GetPostGarbageCollect().AddStatic(&FVertexPaintMeshAdjacencyCache::HandlePostGarbageCollect);
+    }
+
+    FEntry& Entry = Cache.FindOrAdd(Key);
+    if (!Entry.Adjacency.IsValid() || Entry.RenderData != StaticMesh->GetRenderData())
+    {
+        Entry.RenderData = StaticMesh->GetRenderData();
+        Entry.Adjacency = nullptr;
+
+        // Prefer data baked at cook time, matched by vertex and index count so stripped LODs are skipped
+        UVertexPaintMeshData* MeshData = StaticMesh->GetAssetUserData<UVertexPaintMeshData>();
+        if (MeshData && Entry.RenderData->LODResources.IsValidIndex(LODIndex))
+        {
+            const FStaticMeshLODResources& LODResources = Entry.RenderData->LODResources[LODIndex];
+            Entry.Adjacency = MeshData->FindBakedAdjacency(LODResources.GetNumVertices(), LODResources.IndexBuffer.GetNumIndices());
+        }
+
+        if (!Entry.Adjacency.IsValid())
+        {
+            Entry.Adjacency = FVertexPaintMeshAdjacency::Build(StaticMesh, LODIndex);
+        }
+    }
+
+    return Entry.Adjacency;
+}
+
+void FVertexPaintMeshAdjacencyCache::Remove(const UStaticMesh* StaticMesh)
+{
+    const TObjectKey<UStaticMesh> MeshKey(StaticMesh);
+
+    FScopeLock Lock(&CacheLock);
+    for (auto It = Cache.CreateIterator(); It; ++It)
+    {
+        if (It.Key().Key == MeshKey)
+        {
+            It.RemoveCurrent();
+        }
+    }
+}
+
+void FVertexPaintMeshAdjacencyCache::HandlePostGarbageCollect()
+{
+    FScopeLock Lock(&CacheLock);
+    for (auto It = Cache.CreateIterator(); It; ++It)
+    {
+        if (!It.Key().Key.ResolveObjectPtr())
+        {
+            It.RemoveCurrent();
+        }
+    }
+}
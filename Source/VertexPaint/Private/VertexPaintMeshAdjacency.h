@@ -0,0 +1,88 @@
+// Copyright (C) Thyke. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/ObjectKey.h"
+
+class UStaticMesh;
+class FPositionVertexBuffer;
+class FStaticMeshRenderData;
+
+/**
+ * Triangle connectivity of a static mesh LOD, used to walk the surface outward from a hit triangle
+ */
+struct FVertexPaintMeshAdjacency
+{
+    /** Render index buffer, three entries per triangle */
+    TArray<uint32> Indices;
+
+    /** Welded vertex id of each render vertex, so the walk crosses UV and normal seams */
+    TArray<int32> WeldedVertexIds;
+
+    /** Triangles touching each welded vertex, as [Offsets[i], Offsets[i + 1]) ranges into WeldedVertexTriangles */
+    TArray<int32> WeldedVertexTriangleOffsets;
+    TArray<int32> WeldedVertexTriangles;
+
+    /** Render triangle of each collision face, only filled for the LOD used for collision */
+    TArray<int32> CollisionFaceToTriangle;
+
+    int32 GetNumTriangles() const { return Indices.Num() / 3; }
+
+    /**
+     * Builds the adjacency data from the render resources of the given LOD
+     */
+    static TSharedPtr<FVertexPaintMeshAdjacency> Build(const UStaticMesh* StaticMesh, int32 LODIndex);
+
+    /**
+     * Builds the adjacency data from the given render data of the mesh, e.g. the render data cooked for another platform
+     */
+    static TSharedPtr<FVertexPaintMeshAdjacency> Build(const UStaticMesh* StaticMesh, const FStaticMeshRenderData& RenderData, int32 LODIndex);
+
+    /**
+     * Writes or reads the adjacency of several LODs as one versioned blob.
+     * Returns false when loading data of another version or inconsistent data.
+     */
+    static bool SerializeLODs(FArchive& Ar, TArray<TSharedPtr<FVertexPaintMeshAdjacency>>& LODs);
+
+    /**
+     * Walks the triangles around SeedTriangle and collects every vertex within Radius of Center.
+     * The walk stops at triangles that lie entirely outside the radius, so the cost depends on the painted area.
+     */
+    void CollectVerticesInRadius(const FPositionVertexBuffer& Positions, int32 SeedTriangle, const FVector& Center, float Radius, TArray<int32>& OutVertices, TArray<float>& OutDistances) const;
+};
+
+/**
+ * Lazily built adjacency data shared by every component using the same mesh
+ */
+class FVertexPaintMeshAdjacencyCache
+{
+public:
+    /**
+     * Returns the adjacency of the given mesh LOD, using cook-time baked data when the mesh has it
+     * and building it from the render data otherwise
+     */
+    static TSharedPtr<const FVertexPaintMeshAdjacency> Get(UStaticMesh* StaticMesh, int32 LODIndex);
+
+    /**
+     * Drops the cached adjacency of every LOD of the mesh, so the next Get starts from scratch
+     */
+    static void Remove(const UStaticMesh* StaticMesh);
+
+private:
+    struct FEntry
+    {
+        /** Render data the adjacency was built from, used to detect rebuilt meshes */
+        const FStaticMeshRenderData* RenderData = nullptr;
+        TSharedPtr<const FVertexPaintMeshAdjacency> Adjacency;
+    };
+
+    /**
+     * Drops the entries of meshes that were garbage collected
+     */
+    static void HandlePostGarbageCollect();
+
+    static FCriticalSection CacheLock;
+    static TMap<TPair<TObjectKey<UStaticMesh>, int32>, FEntry> Cache;
+    static FDelegateHandle PostGarbageCollectHandle;
+};
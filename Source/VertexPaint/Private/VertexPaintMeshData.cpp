@@ -0,0 +1,154 @@
+// Copyright (C) Thyke. All Rights Reserved.
+
+#include "VertexPaintMeshData.h"
+#include "VertexPaintMeshAdjacency.h"
+#include "Engine/StaticMesh.h"
+#include "Interfaces/ITargetPlatform.h"
+#include "Serialization/BufferReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "StaticMeshResources.h"
+#include "UObject/ObjectSaveContext.h"
+
+#include UE_INLINE_GENERATED_CPP_BY_NAME(VertexPaintMeshData)
+
+void UVertexPaintMeshData::Serialize(FArchive& Ar)
+{
+    Super::Serialize(Ar);
+
+    BakedData.Serialize(Ar, this);
+}
+
+void UVertexPaintMeshData::PostLoad()
+{
+    Super::PostLoad();
+
+    if (BakedData.GetBulkDataSize() == 0)
+    {
+        return;
+    }
+
+    // Inline payloads are already resident
+    if (BakedData.IsBulkDataLoaded())
+    {
+        DecodeBakedData(static_cast<const uint8*>(BakedData.LockReadOnly()), BakedData.GetBulkDataSize());
+        BakedData.Unlock();
+        BakedData.RemoveBulkData();
+        return;
+    }
+
+    FBulkDataIORequestCallBack Callback = [this](bool bWasCancelled, IBulkDataIORequest* Request)
+    {
+        if (!bWasCancelled)
+        {
+            uint8* ReadResults = Request->GetReadResults();
+            DecodeBakedData(ReadResults, Request->GetSize());
+            FMemory::Free(ReadResults);
+        }
+    };
+    LoadRequest.Reset(BakedData.CreateStreamingRequest(AIOP_BelowNormal, &Callback, nullptr));
+}
+
+void UVertexPaintMeshData::BeginDestroy()
+{
+    if (LoadRequest.IsValid())
+    {
+        LoadRequest->Cancel();
+        LoadRequest->WaitCompletion();
+        LoadRequest.Reset();
+    }
+
+    Super::BeginDestroy();
+}
+
+#if WITH_EDITOR
+void UVertexPaintMeshData::PreSave(FObjectPreSaveContext SaveContext)
+{
+    Super::PreSave(SaveContext);
+
+    // Editor builds always use the runtime builder, so only cooked packages carry the payload
+    BakedData.RemoveBulkData();
+    if (!SaveContext.IsCooking())
+    {
+        return;
+    }
+
+    UStaticMesh* StaticMesh = GetTypedOuter<UStaticMesh>();
+    const ITargetPlatform* TargetPlatform = SaveContext.GetTargetPlatform();
+    if (!StaticMesh || StaticMesh->IsCompiling() || !StaticMesh->GetRenderData() || !TargetPlatform)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("VertexPaint: Can't bake paint data of %s - render data not available"), *GetPathName());
+        return;
+    }
+
+    // The editor's render data is built for the host; the target platform can have other LODs and reduction,
+    // which would then never match the baked data at runtime
+    FStaticMeshRenderData PlatformRenderData;
+    PlatformRenderData.Cache(TargetPlatform, StaticMesh, TargetPlatform->GetStaticMeshLODSettings());
+
+    TArray<TSharedPtr<FVertexPaintMeshAdjacency>> LODs;
+    for (int32 LODIndex = 0; LODIndex < PlatformRenderData.LODResources.Num(); LODIndex++)
+    {
+        const FStaticMeshLODResources& LODResources = PlatformRenderData.LODResources[LODIndex];
+        TSharedPtr<FVertexPaintMeshAdjacency> Adjacency = LODResources.GetNumVertices() > 0 && LODResources.IndexBuffer.GetNumIndices() > 0
+            ? FVertexPaintMeshAdjacency::Build(StaticMesh, PlatformRenderData, LODIndex)
+            : nullptr;
+        if (!Adjacency.IsValid())
+        {
+            UE_LOG(LogTemp, Warning, TEXT("VertexPaint: Can't bake paint data of LOD %d of %s for %s, it will be built on first paint"),
+                LODIndex, *StaticMesh->GetPathName(), *TargetPlatform->PlatformName());
+            continue;
+        }
+
+        LODs.Add(Adjacency);
+    }
+
+    TArray<uint8> Payload;
+    FMemoryWriter Writer(Payload, true);
+    FVertexPaintMeshAdjacency::SerializeLODs(Writer, LODs);
+
+    // Keep the payload out of the export so loading the mesh stays cheap; it is streamed in after load
+    BakedData.SetBulkDataFlags(BULKDATA_Force_NOT_InlinePayload);
+    BakedData.Lock(LOCK_READ_WRITE);
+    FMemory::Memcpy(BakedData.Realloc(Payload.Num()), Payload.GetData(), Payload.Num());
+    BakedData.Unlock();
+}
+#endif
+
+TSharedPtr<const FVertexPaintMeshAdjacency> UVertexPaintMeshData::FindBakedAdjacency(int32 NumVertices, int32 NumIndices)
+{
+    if (LoadRequest.IsValid())
+    {
+        LoadRequest->WaitCompletion();
+        LoadRequest.Reset();
+    }
+
+    FScopeLock Lock(&BakedLODsLock);
+    for (const TSharedPtr<FVertexPaintMeshAdjacency>& Adjacency : BakedLODs)
+    {
+        if (Adjacency->WeldedVertexIds.Num() == NumVertices && Adjacency->Indices.Num() == NumIndices)
+        {
+            return Adjacency;
+        }
+    }
+
+    return nullptr;
+}
+
+void UVertexPaintMeshData::DecodeBakedData(const uint8* Data, int64 Size)
+{
+    if (!Data || Size <= 0)
+    {
+        return;
+    }
+
+    TArray<TSharedPtr<FVertexPaintMeshAdjacency>> DecodedLODs;
+    FBufferReader Reader(const_cast<uint8*>(Data), Size, false, true);
+    if (!FVertexPaintMeshAdjacency::SerializeLODs(Reader, DecodedLODs))
+    {
+        UE_LOG(LogTemp, Warning, TEXT("VertexPaint: Ignoring outdated or corrupt baked paint data in %s"), *GetPathName());
+        return;
+    }
+
+    FScopeLock Lock(&BakedLODsLock);
+    BakedLODs = MoveTemp(DecodedLODs);
+}
@@ -0,0 +1,256 @@
+// Copyright (C) Thyke. All Rights Reserved.
+
+#include "VertexPaintSkinnedPositionCache.h"
+#include "Components/SkinnedMeshComponent.h"
+#include "Rendering/SkeletalMeshLODRenderData.h"
+#include "Rendering/SkeletalMeshRenderData.h"
+
+TMap<TPair<TObjectKey<USkinnedMeshComponent>, int32>, TSharedPtr<FVertexPaintSkinnedPositions>> FVertexPaintSkinnedPositionCache::Cache;
+uint64 FVertexPaintSkinnedPositionCache::LastPruneFrame = MAX_uint64;
+
+TSharedPtr<FVertexPaintSkinnedPositions> FVertexPaintSkinnedPositions::Build(const USkinnedMeshComponent* SkinnedMeshComponent, int32 LODIndex)
+{
+    const FSkeletalMeshRenderData* RenderData = SkinnedMeshComponent ? SkinnedMeshComponent->GetSkeletalMeshRenderData() : nullptr;
+    if (!RenderData || !RenderData->LODRenderData.IsValidIndex(LODIndex))
+    {
+        return nullptr;
+    }
+
+    const FSkeletalMeshLODRenderData& LODData = RenderData->LODRenderData[LODIndex];
+    const FPositionVertexBuffer& PositionBuffer = LODData.StaticVertexBuffers.PositionVertexBuffer;
+    const FSkinWeightVertexBuffer* SkinWeightBuffer = SkinnedMeshComponent->GetSkinWeightBuffer(LODIndex);
+    const int32 VertexNum = PositionBuffer.GetNumVertices();
+
+    if (!SkinWeightBuffer || !PositionBuffer.GetVertexData() || static_cast<int32>(SkinWeightBuffer->GetNumVertices()) != VertexNum)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("VertexPaint: Vertex data of %s is not available on the CPU, enable Allow CPU Access on the mesh LOD"), *SkinnedMeshComponent->GetPathName());
+        return nullptr;
+    }
+
+    TSharedPtr<FVertexPaintSkinnedPositions> Positions = MakeShared<FVertexPaintSkinnedPositions>();
+    Positions->LODData = &LODData;
+    Positions->SkinWeightBuffer = SkinWeightBuffer;
+
+    Positions->RefPositions.SetNumUninitialized(VertexNum);
+    for (int32 VertexIndex = 0; VertexIndex < VertexNum; VertexIndex++)
+    {
+        Positions->RefPositions[VertexIndex] = PositionBuffer.VertexPosition(VertexIndex);
+    }
+    Positions->SkinnedPositions = Positions->RefPositions;
+
+    // Skin weights store section bone indices, resolve them to mesh bones through the section bone map
+    TArray<int32> VertexSections;
+    VertexSections.Init(INDEX_NONE, VertexNum);
+    for (int32 SectionIndex = 0; SectionIndex < LODData.RenderSections.Num(); SectionIndex++)
+    {
+        const FSkelMeshRenderSection& Section = LODData.RenderSections[SectionIndex];
+        const int32 LastVertex = FMath::Min<int32>(Section.BaseVertexIndex + Section.NumVertices, VertexNum);
+        for (int32 VertexIndex = Section.BaseVertexIndex; VertexIndex < LastVertex; VertexIndex++)
+        {
+            VertexSections[VertexIndex] = SectionIndex;
+        }
+    }
+
+    const int32 MaxInfluences = SkinWeightBuffer->GetMaxBoneInfluences();
+    int32 BoneNum = 0;
+    Positions->InfluenceOffsets.Reserve(VertexNum + 1);
+    Positions->InfluenceOffsets.Add(0);
+    for (int32 VertexIndex = 0; VertexIndex < VertexNum; VertexIndex++)
+    {
+        if (VertexSections[VertexIndex] != INDEX_NONE)
+        {
+            const TArray<FBoneIndexType>& BoneMap = LODData.RenderSections[VertexSections[VertexIndex]].BoneMap;
+            const int32 FirstInfluence = Positions->Influences.Num();
+            float TotalWeight = 0.0f;
+
+            for (int32 InfluenceIndex = 0; InfluenceIndex < MaxInfluences; InfluenceIndex++)
+            {
+                const uint16 Weight = SkinWeightBuffer->GetBoneWeight(VertexIndex, InfluenceIndex);
+                const int32 SectionBoneIndex = SkinWeightBuffer->GetBoneIndex(VertexIndex, InfluenceIndex);
+                if (Weight == 0 || !BoneMap.IsValidIndex(SectionBoneIndex))
+                {
+                    continue;
+                }
+
+                FInfluence& Influence = Positions->Influences.AddDefaulted_GetRef();
+                Influence.BoneIndex = BoneMap[SectionBoneIndex];
+                Influence.Weight = Weight;
+                TotalWeight += Weight;
+                BoneNum = FMath::Max(BoneNum, Influence.BoneIndex + 1);
+            }
+
+            for (int32 InfluenceIndex = FirstInfluence; InfluenceIndex < Positions->Influences.Num(); InfluenceIndex++)
+            {
+                Positions->Influences[InfluenceIndex].Weight /= TotalWeight;
+            }
+        }
+
+        Positions->InfluenceOffsets.Add(Positions->Influences.Num());
+    }
+
+    // Invert into the vertices of each bone
+    TArray<int32>& BoneOffsets = Positions->BoneVertexOffsets;
+    BoneOffsets.SetNumZeroed(BoneNum + 1);
+    for (const FInfluence& Influence : Positions->Influences)
+    {
+        BoneOffsets[Influence.BoneIndex + 1]++;
+    }
+    for (int32 BoneIndex = 0; BoneIndex < BoneNum; BoneIndex++)
+    {
+        BoneOffsets[BoneIndex + 1] += BoneOffsets[BoneIndex];
+    }
+
+    TArray<int32> FillCursor(BoneOffsets.GetData(), BoneNum);
+    Positions->BoneVertices.SetNumUninitialized(Positions->Influences.Num());
+    for (int32 VertexIndex = 0; VertexIndex < VertexNum; VertexIndex++)
+    {
+        for (int32 InfluenceIndex = Positions->InfluenceOffsets[VertexIndex]; InfluenceIndex < Positions->InfluenceOffsets[VertexIndex + 1]; InfluenceIndex++)
+        {
+            Positions->BoneVertices[FillCursor[Positions->Influences[InfluenceIndex].BoneIndex]++] = VertexIndex;
+        }
+    }
+
+    return Positions;
+}
+
+void FVertexPaintSkinnedPositions::Refresh(const TArray<FMatrix44f>& NewRefToLocals)
+{
+    const int32 VertexNum = RefPositions.Num();
+
+    // Different bone count, e.g. the first refresh: skin everything
+    if (RefToLocals.Num() != NewRefToLocals.Num())
+    {
+        RefToLocals = NewRefToLocals;
+        for (int32 VertexIndex = 0; VertexIndex < VertexNum; VertexIndex++)
+        {
+            SkinVertex(VertexIndex);
+        }
+        return;
+    }
+
+    TBitArray<> DirtyVertexMask(false, VertexNum);
+    TArray<int32> DirtyVertices;
+
+    const int32 MappedBoneNum = BoneVertexOffsets.Num() - 1;
+    for (int32 BoneIndex = 0; BoneIndex < NewRefToLocals.Num(); BoneIndex++)
+    {
+        if (NewRefToLocals[BoneIndex] == RefToLocals[BoneIndex])
+        {
+            continue;
+        }
+
+        RefToLocals[BoneIndex] = NewRefToLocals[BoneIndex];
+        if (BoneIndex >= MappedBoneNum)
+        {
+            continue;
+        }
+
+        for (int32 Slot = BoneVertexOffsets[BoneIndex]; Slot < BoneVertexOffsets[BoneIndex + 1]; Slot++)
+        {
+            const int32 VertexIndex = BoneVertices[Slot];
+            if (!DirtyVertexMask[VertexIndex])
+            {
+                DirtyVertexMask[VertexIndex] = true;
+                DirtyVertices.Add(VertexIndex);
+            }
+        }
+    }
+
+    for (const int32 VertexIndex : DirtyVertices)
+    {
+        SkinVertex(VertexIndex);
+    }
+}
+
+void FVertexPaintSkinnedPositions::SkinVertex(int32 VertexIndex)
+{
+    const int32 FirstInfluence = InfluenceOffsets[VertexIndex];
+    const int32 LastInfluence = InfluenceOffsets[VertexIndex + 1];
+    if (FirstInfluence == LastInfluence)
+    {
+        SkinnedPositions[VertexIndex] = RefPositions[VertexIndex];
+        return;
+    }
+
+    FVector3f SkinnedPosition = FVector3f::ZeroVector;
+    for (int32 InfluenceIndex = FirstInfluence; InfluenceIndex < LastInfluence; InfluenceIndex++)
+    {
+        const FInfluence& Influence = Influences[InfluenceIndex];
+        if (RefToLocals.IsValidIndex(Influence.BoneIndex))
+        {
+            SkinnedPosition += FVector3f(RefToLocals[Influence.BoneIndex].TransformPosition(RefPositions[VertexIndex])) * Influence.Weight;
+        }
+    }
+
+    SkinnedPositions[VertexIndex] = SkinnedPosition;
+}
+
+TSharedPtr<const FVertexPaintSkinnedPositions> FVertexPaintSkinnedPositionCache::Get(USkinnedMeshComponent* SkinnedMeshComponent, int32 LODIndex)
+{
+    return Get(SkinnedMeshComponent, LODIndex, GFrameCounter, [SkinnedMeshComponent](TArray<FMatrix44f>& OutRefToLocals)
+    {
+        SkinnedMeshComponent->CacheRefToLocalMatrices(OutRefToLocals);
+    });
+}
+
+TSharedPtr<const FVertexPaintSkinnedPositions> FVertexPaintSkinnedPositionCache::Get(USkinnedMeshComponent* SkinnedMeshComponent, int32 LODIndex, uint64 Frame, TFunctionRef<void(TArray<FMatrix44f>&)> GetRefToLocals)
+{
+    check(IsInGameThread());
+
+    const FSkeletalMeshRenderData* RenderData = SkinnedMeshComponent ? SkinnedMeshComponent->GetSkeletalMeshRenderData() : nullptr;
+    if (!RenderData || !RenderData->LODRenderData.IsValidIndex(LODIndex))
+    {
+        return nullptr;
+    }
+
+    // Drop entries of destroyed components once per frame
+    if (LastPruneFrame != Frame)
+    {
+        LastPruneFrame = Frame;
+        for (auto It = Cache.CreateIterator(); It; ++It)
+        {
+            if (!It.Key().Key.ResolveObjectPtr())
+            {
+                It.RemoveCurrent();
+            }
+        }
+    }
+
+    const TPair<TObjectKey<USkinnedMeshComponent>, int32> Key(SkinnedMeshComponent, LODIndex);
+    TSharedPtr<FVertexPaintSkinnedPositions> Positions = Cache.FindRef(Key);
+    if (!Positions.IsValid()
+        || Positions->LODData != &RenderData->LODRenderData[LODIndex]
+        || Positions->SkinWeightBuffer != SkinnedMeshComponent->GetSkinWeightBuffer(LODIndex))
+    {
+        Positions = FVertexPaintSkinnedPositions::Build(SkinnedMeshComponent, LODIndex);
+        if (!Positions.IsValid())
+        {
+            Cache.Remove(Key);
+            return nullptr;
+        }
+        Cache.Add(Key, Positions);
+    }
+
+    // Strokes in the same frame reuse the positions of the first one
+    if (Positions->LastRefreshFrame != Frame)
+    {
+        TArray<FMatrix44f> RefToLocals;
+        GetRefToLocals(RefToLocals);
+        Positions->Refresh(RefToLocals);
+        Positions->LastRefreshFrame = Frame;
+    }
+
+    return Positions;
+}
+
+void FVertexPaintSkinnedPositionCache::Remove(const USkinnedMeshComponent* SkinnedMeshComponent)
+{
+    const TObjectKey<USkinnedMeshComponent> ComponentKey(SkinnedMeshComponent);
+    for (auto It = Cache.CreateIterator(); It; ++It)
+    {
+        if (It.Key().Key == ComponentKey)
+        {
+            It.RemoveCurrent();
+        }
+    }
+}
@@ -0,0 +1,85 @@
+// Copyright (C) Thyke. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/ObjectKey.h"
+
+class USkinnedMeshComponent;
+class FSkeletalMeshLODRenderData;
+class FSkinWeightVertexBuffer;
+
+/**
+ * CPU-skinned vertex positions of one skinned mesh component LOD, in component space.
+ * Only vertices influenced by bones whose ref-to-local matrix changed are skinned again.
+ */
+struct FVertexPaintSkinnedPositions
+{
+    struct FInfluence
+    {
+        int32 BoneIndex = 0;
+        float Weight = 0.0f;
+    };
+
+    /** Render data the influences were gathered from, used to detect mesh or skin weight changes */
+    const FSkeletalMeshLODRenderData* LODData = nullptr;
+    const FSkinWeightVertexBuffer* SkinWeightBuffer = nullptr;
+
+    TArray<FVector3f> RefPositions;
+
+    /** Mesh bone influences of each vertex, as [Offsets[i], Offsets[i + 1]) ranges into Influences */
+    TArray<int32> InfluenceOffsets;
+    TArray<FInfluence> Influences;
+
+    /** Vertices influenced by each mesh bone, as [Offsets[i], Offsets[i + 1]) ranges into BoneVertices */
+    TArray<int32> BoneVertexOffsets;
+    TArray<int32> BoneVertices;
+
+    /** Matrices the current positions were skinned with */
+    TArray<FMatrix44f> RefToLocals;
+
+    TArray<FVector3f> SkinnedPositions;
+
+    /** Frame the positions were last refreshed in */
+    uint64 LastRefreshFrame = MAX_uint64;
+
+    /**
+     * Gathers the influences of the given LOD. Requires CPU access to the LOD vertex buffers.
+     */
+    static TSharedPtr<FVertexPaintSkinnedPositions> Build(const USkinnedMeshComponent* SkinnedMeshComponent, int32 LODIndex);
+
+    /**
+     * Skins again every vertex influenced by a bone whose matrix differs from the previous refresh
+     */
+    void Refresh(const TArray<FMatrix44f>& NewRefToLocals);
+
+private:
+    void SkinVertex(int32 VertexIndex);
+};
+
+/**
+ * Skinned positions of painted components, refreshed at most once per frame so several strokes
+ * in the same frame share them. Game thread only.
+ */
+class FVertexPaintSkinnedPositionCache
+{
+public:
+    /**
+     * Returns the component space positions of the given component LOD, or null if they can't be computed
+     */
+    static TSharedPtr<const FVertexPaintSkinnedPositions> Get(USkinnedMeshComponent* SkinnedMeshComponent, int32 LODIndex);
+
+    /**
+     * Get for the given frame, with the bone matrices supplied by the caller when a refresh is needed
+     */
+    static TSharedPtr<const FVertexPaintSkinnedPositions> Get(USkinnedMeshComponent* SkinnedMeshComponent, int32 LODIndex, uint64 Frame, TFunctionRef<void(TArray<FMatrix44f>&)> GetRefToLocals);
+
+    /**
+     * Drops the cached positions of every LOD of the component
+     */
+    static void Remove(const USkinnedMeshComponent* SkinnedMeshComponent);
+
+private:
+    static TMap<TPair<TObjectKey<USkinnedMeshComponent>, int32>, TSharedPtr<FVertexPaintSkinnedPositions>> Cache;
+    static uint64 LastPruneFrame;
+};
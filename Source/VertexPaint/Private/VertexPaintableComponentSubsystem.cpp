@@ -0,0 +1,60 @@
+// Copyright (C) Thyke. All Rights Reserved.
+
+#include "VertexPaintableComponentSubsystem.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/World.h"
+
+#include UE_INLINE_GENERATED_CPP_BY_NAME(VertexPaintableComponentSubsystem)
+
+bool UVertexPaintableComponentSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+    return WorldType == EWorldType::Game
+        || WorldType == EWorldType::PIE
+        || WorldType == EWorldType::Editor
+        || WorldType == EWorldType::EditorPreview
+        || WorldType == EWorldType::GamePreview;
+}
+
+void UVertexPaintableComponentSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+    Super::Initialize(Collection);
+
+    PreLevelRemovedHandle = FWorldDelegates::PreLevelRemovedFromWorld.AddUObject(this, &UVertexPaintableComponentSubsystem::HandlePreLevelRemovedFromWorld);
+}
+
+void UVertexPaintableComponentSubsystem::Deinitialize()
+{
+    FWorldDelegates::PreLevelRemovedFromWorld.Remove(PreLevelRemovedHandle);
+    PaintableComponents.Empty();
+
+    Super::Deinitialize();
+}
+
+void UVertexPaintableComponentSubsystem::RegisterPaintableComponent(UStaticMeshComponent* StaticMeshComponent)
+{
+    if (StaticMeshComponent)
+    {
+        PaintableComponents.Add(StaticMeshComponent);
+    }
+}
+
+void UVertexPaintableComponentSubsystem::UnregisterPaintableComponent(UStaticMeshComponent* StaticMeshComponent)
+{
+    PaintableComponents.Remove(StaticMeshComponent);
+}
+
+void UVertexPaintableComponentSubsystem::HandlePreLevelRemovedFromWorld(ULevel* Level, UWorld* World)
+{
+    if (World != GetWorld())
+    {
+        return;
+    }
+
+    for (TSet<TWeakObjectPtr<UStaticMeshComponent>>::TIterator It = PaintableComponents.CreateIterator(); It; ++It)
+    {
+        if (!It->IsValid() || (*It)->GetComponentLevel() == Level)
+        {
+            It.RemoveCurrent();
+        }
+    }
+}
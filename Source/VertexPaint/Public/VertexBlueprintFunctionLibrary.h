@@ -4,8 +4,13 @@
 
 #include "CoreMinimal.h"
 #include "Kismet/BlueprintFunctionLibrary.h"
+#include "Engine/HitResult.h"
 #include "VertexBlueprintFunctionLibrary.generated.h"
 
+class FColorVertexBuffer;
+class USkeletalMeshComponent;
+class UStaticMeshComponent;
+
 /**
  * Shape types to be used for vertex painting
  */
@@ -96,6 +101,16 @@ struct FVertexPaintUndoRedoState
     int32 LODIndex = 0;
 };
 
+/**
+ * Color buffer waiting to be applied to a component LOD
+ */
+struct FVertexPaintColorUpload
+{
+    UStaticMeshComponent* StaticMeshComponent = nullptr;
+    int32 LODIndex = 0;
+    FColorVertexBuffer* VertexColors = nullptr;
+};
+
 /**
  * Blueprint Function Library for Runtime Vertex Painting
  */
@@ -104,6 +119,9 @@ class VERTEXPAINT_API UVertexBlueprintFunctionLibrary : public UBlueprintFunctio
 {
     GENERATED_BODY()
 
+    friend class UVertexPaintCacheSubsystem;
+    friend struct FVertexPaintBenchmarks;
+
     ///// BASIC FUNCTIONS /////
     
     /**
@@ -147,12 +165,44 @@ class VERTEXPAINT_API UVertexBlueprintFunctionLibrary : public UBlueprintFunctio
                            float Falloff = 0.5f, 
                            int32 LODIndex = 0);
 
+    /**
+     * Paints a sphere around a trace hit by walking the mesh surface outward from the hit triangle.
+     * Requires a hit with a face index (complex collision trace with face index returned);
+     * falls back to Paint Mesh Region otherwise. After the first stroke on a LOD, only the painted
+     * colors are updated and uploaded, without a rendering flush.
+     */
+    UFUNCTION(BlueprintCallable, Category = "Vertex", DisplayName = "Paint Mesh At Hit")
+    static bool PaintMeshAtHit(UStaticMeshComponent* StaticMeshComponent,
+                           const FHitResult& Hit,
+                           float Radius,
+                           FLinearColor Color,
+                           EVertexColorBlendMode BlendMode = EVertexColorBlendMode::Replace,
+                           float BlendStrength = 1.0f,
+                           float Falloff = 0.5f,
+                           int32 LODIndex = 0);
+
     /**
      * Paints the mesh using parameters
      */
     UFUNCTION(BlueprintCallable, Category = "Vertex", DisplayName = "Paint Mesh With Parameters")
     static bool PaintMeshWithParameters(UStaticMeshComponent* StaticMeshComponent, const FVertexPaintParameters& Parameters, int32 LODIndex = 0);
 
+    /**
+     * Paints every static mesh component touched by the shape, evaluated in world space so component scale and rotation do not change its size.
+     * Components are found through the physics scene and the registered paintable components,
+     * evaluated in parallel and uploaded as one batch. Returns the painted components.
+     */
+    UFUNCTION(BlueprintCallable, Category = "Vertex", DisplayName = "Paint World Region", meta = (WorldContext = "WorldContextObject"))
+    static TArray<UStaticMeshComponent*> PaintWorldRegion(const UObject* WorldContextObject, const FVertexPaintParameters& Parameters, int32 LODIndex = 0);
+
+    /**
+     * Paints a region of a skeletal mesh in its current pose, using the skeletal mesh vertex color override.
+     * Skinned positions are cached per component and only recomputed for bones that moved since the last frame.
+     * Requires Allow CPU Access on the skeletal mesh LODs in cooked builds.
+     */
+    UFUNCTION(BlueprintCallable, Category = "Vertex", DisplayName = "Paint Skeletal Mesh Region")
+    static bool PaintSkeletalMeshRegion(USkeletalMeshComponent* SkeletalMeshComponent, const FVertexPaintParameters& Parameters, int32 LODIndex = 0);
+
     /**
      * Blends two colors
      */
@@ -205,13 +255,62 @@ private:
      */
     static bool ValidateMeshForPainting(UStaticMeshComponent* StaticMeshComponent, int32 LODIndex, int32& OutVertexCount);
     
+    /**
+     * Paints a single LOD of a skeletal mesh
+     */
+    static bool PaintSkeletalMeshLOD(USkeletalMeshComponent* SkeletalMeshComponent, const FVertexPaintParameters& Parameters, int32 LODIndex);
+
     /**
      * Applies the color buffer
      */
     static void ApplyColorBuffer(UStaticMeshComponent* StaticMeshComponent, int32 LODIndex, const TArray<FColor>& VertexColors);
+
+    /**
+     * Takes ownership of an already initialized color buffer and applies it,
+     * only flushing rendering commands when an existing buffer has to be released
+     */
+    static void ApplyColorVertexBuffer(UStaticMeshComponent* StaticMeshComponent, int32 LODIndex, FColorVertexBuffer* NewVertexColors);
+
+    /**
+     * Applies several color buffers, waiting for the render thread at most once
+     */
+    static void ApplyColorVertexBuffers(TArrayView<const FVertexPaintColorUpload> Uploads);
+
+    /**
+     * Uploads the given vertices of the existing color buffer of a LOD after its CPU copy was edited in place,
+     * without waiting for the render thread
+     */
+    static void UpdateColorVertexBuffer(UStaticMeshComponent* StaticMeshComponent, int32 LODIndex, TArray<int32> VertexIndices);
+
+    /**
+     * Lets the paint cache know that a component was painted
+     */
+    static void NotifyComponentPainted(UStaticMeshComponent* StaticMeshComponent);
+
+    /**
+     * Reads the current colors of an already validated mesh LOD
+     */
+    static void ReadVertexColors(const UStaticMeshComponent* StaticMeshComponent, int32 LODIndex, int32 VertexNum, TArray<FColor>& OutVertexColors);
+
+    /**
+     * Blends the color into every vertex inside the world space shape, returns true if any vertex was painted.
+     * GetVertexPosition returns the component space position of a vertex index.
+     */
+    template<typename GetVertexPositionType>
+    static bool PaintRegionColors(int32 VertexNum, const GetVertexPositionType& GetVertexPosition, const FTransform& ComponentTransform, EVertexPaintShape Shape, const FVector& Location, const FVector& Dimensions, const FRotator& Rotation, const FLinearColor& Color, EVertexColorBlendMode BlendMode, float BlendStrength, float Falloff, TArray<FColor>& VertexColors);
+
+    /**
+     * Paint Region Colors for component space positions stored in an array, such as skinned positions
+     */
+    static bool PaintRegionColors(TConstArrayView<FVector3f> VertexPositions, const FTransform& ComponentTransform, EVertexPaintShape Shape, const FVector& Location, const FVector& Dimensions, const FRotator& Rotation, const FLinearColor& Color, EVertexColorBlendMode BlendMode, float BlendStrength, float Falloff, TArray<FColor>& VertexColors);
     
     /**
      * Checks if a vertex is within the specified area
      */
     static float GetVertexDistanceNormalizedToShape(const FVector& VertexPosition, EVertexPaintShape Shape, const FVector& Location, const FVector& Dimensions, const FRotator& Rotation);
+
+    /**
+     * Gets the paint strength multiplier for a normalized distance (edges are less affected)
+     */
+    static float GetFalloffAlpha(float NormalizedDistance, float Falloff);
 };
\ No newline at end of file
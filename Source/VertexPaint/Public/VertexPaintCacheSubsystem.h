@@ -0,0 +1,86 @@
+// Copyright (C) Thyke. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tasks/Pipe.h"
+#include "Tasks/Task.h"
+#include "VertexPaintCacheSubsystem.generated.h"
+
+class UStaticMeshComponent;
+struct FVertexPaintCacheStorage;
+
+/**
+ * Keeps runtime paint of static mesh components alive across level streaming.
+ *
+ * Painted components are saved as compressed paint when their level streams out. The paint is kept in an
+ * LRU memory cache and written to Saved/VertexPaintCache, so it also survives across sessions. When the
+ * level streams back in, the paint is decoded on a worker thread and applied without a rendering flush.
+ */
+UCLASS()
+class VERTEXPAINT_API UVertexPaintCacheSubsystem : public UWorldSubsystem
+{
+    GENERATED_BODY()
+
+public:
+    virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+    virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+    virtual void Deinitialize() override;
+
+    /**
+     * Marks a component as painted so its paint is saved when its level streams out
+     */
+    void NotifyComponentPainted(UStaticMeshComponent* StaticMeshComponent);
+
+    /**
+     * Saves the current paint of a component to the paint cache
+     */
+    UFUNCTION(BlueprintCallable, Category = "Vertex", DisplayName = "Save Component Paint To Cache")
+    bool SaveComponentPaint(UStaticMeshComponent* StaticMeshComponent);
+
+    /**
+     * Starts restoring cached paint of a component, returns false if nothing is cached for it.
+     * The restore is skipped if the component is painted before the cached paint is ready.
+     */
+    UFUNCTION(BlueprintCallable, Category = "Vertex", DisplayName = "Restore Component Paint From Cache")
+    bool RestoreComponentPaint(UStaticMeshComponent* StaticMeshComponent);
+
+    /**
+     * Removes all cached paint from memory and disk
+     */
+    UFUNCTION(BlueprintCallable, Category = "Vertex", DisplayName = "Clear Paint Cache")
+    void ClearPaintCache();
+
+protected:
+    virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+    void HandlePreLevelRemovedFromWorld(ULevel* Level, UWorld* World);
+    void HandleLevelAddedToWorld(ULevel* Level, UWorld* World);
+
+    /**
+     * Builds an identity for the component that stays the same across sessions and PIE instances
+     */
+    FString GetStableComponentPath(const UStaticMeshComponent* StaticMeshComponent) const;
+
+    void AddPendingTask(UE::Tasks::FTask Task);
+
+    TSharedPtr<FVertexPaintCacheStorage, ESPMode::ThreadSafe> Storage;
+
+    /**
+     * Returns a counter that changes whenever the component is painted, used to detect paint applied during a restore
+     */
+    uint32 GetPaintGeneration(const UStaticMeshComponent* StaticMeshComponent) const;
+
+    /** Painted components and their paint generation */
+    TMap<TWeakObjectPtr<UStaticMeshComponent>, uint32> PaintedComponents;
+
+    /** Serializes save tasks, so captures of the same component reach the disk in order */
+    UE::Tasks::FPipe CommitPipe{ UE_SOURCE_LOCATION };
+
+    TArray<UE::Tasks::FTask> PendingTasks;
+
+    FDelegateHandle PreLevelRemovedHandle;
+    FDelegateHandle LevelAddedHandle;
+};
@@ -0,0 +1,51 @@
+// Copyright (C) Thyke. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/AssetUserData.h"
+#include "Serialization/BulkData.h"
+#include "VertexPaintMeshData.generated.h"
+
+struct FVertexPaintMeshAdjacency;
+
+/**
+ * Paint acceleration data of a static mesh, baked when the mesh is cooked.
+ *
+ * Add it to the Asset User Data of meshes that are painted at runtime. The cook stores the triangle
+ * adjacency of every LOD in a versioned bulk data payload that is streamed in asynchronously after load,
+ * so the first paint does not have to build it. Meshes without baked data build it on first paint instead.
+ */
+UCLASS(BlueprintType, EditInlineNew, DefaultToInstanced, meta = (DisplayName = "Vertex Paint Mesh Data"))
+class VERTEXPAINT_API UVertexPaintMeshData : public UAssetUserData
+{
+    GENERATED_BODY()
+
+public:
+    virtual void Serialize(FArchive& Ar) override;
+    virtual void PostLoad() override;
+    virtual void BeginDestroy() override;
+#if WITH_EDITOR
+    virtual void PreSave(FObjectPreSaveContext SaveContext) override;
+#endif
+
+    /**
+     * Returns the baked adjacency of the LOD with the given render vertex and index count, or null if none was baked.
+     * Waits for the baked payload if it is still streaming in.
+     */
+    TSharedPtr<const FVertexPaintMeshAdjacency> FindBakedAdjacency(int32 NumVertices, int32 NumIndices);
+
+private:
+    /**
+     * Decodes a baked payload, called from the streaming callback or with resident bulk data
+     */
+    void DecodeBakedData(const uint8* Data, int64 Size);
+
+    /** Versioned adjacency blob of all LODs, only written when cooking */
+    FByteBulkData BakedData;
+
+    TUniquePtr<IBulkDataIORequest> LoadRequest;
+
+    FCriticalSection BakedLODsLock;
+    TArray<TSharedPtr<FVertexPaintMeshAdjacency>> BakedLODs;
+};
@@ -0,0 +1,49 @@
+// Copyright (C) Thyke. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "VertexPaintableComponentSubsystem.generated.h"
+
+class UStaticMeshComponent;
+
+/**
+ * Holds the components registered as paintable for Paint World Region, in game, editor and preview worlds.
+ *
+ * Paint World Region finds components through the physics scene; register components here that have
+ * no query collision but should still be painted. Components of levels that stream out are dropped.
+ */
+UCLASS()
+class VERTEXPAINT_API UVertexPaintableComponentSubsystem : public UWorldSubsystem
+{
+    GENERATED_BODY()
+
+public:
+    virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+    virtual void Deinitialize() override;
+
+    /**
+     * Adds a component that Paint World Region should find even when it has no query collision
+     */
+    UFUNCTION(BlueprintCallable, Category = "Vertex", DisplayName = "Register Paintable Component")
+    void RegisterPaintableComponent(UStaticMeshComponent* StaticMeshComponent);
+
+    /**
+     * Removes a component added with Register Paintable Component
+     */
+    UFUNCTION(BlueprintCallable, Category = "Vertex", DisplayName = "Unregister Paintable Component")
+    void UnregisterPaintableComponent(UStaticMeshComponent* StaticMeshComponent);
+
+    const TSet<TWeakObjectPtr<UStaticMeshComponent>>& GetPaintableComponents() const { return PaintableComponents; }
+
+protected:
+    virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+    void HandlePreLevelRemovedFromWorld(ULevel* Level, UWorld* World);
+
+    TSet<TWeakObjectPtr<UStaticMeshComponent>> PaintableComponents;
+
+    FDelegateHandle PreLevelRemovedHandle;
+};